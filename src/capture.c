@@ -0,0 +1,202 @@
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Чтение ровно size байт. Возвращает 0 при успехе, -1 при конце файла или ошибке
+static int read_full(int fd, void *buffer, size_t size) {
+    char *p = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Разбор одного ключа записи/воспроизведения. Возвращает 1, если ключ распознан (и *i сдвинут
+// на его значение), иначе 0 - ключ разбирает сам сервис
+int capture_parse_arg(int argc, char **argv, int *i, struct capture_options *options) {
+    if (strcmp(argv[*i], "--record") == 0 && *i + 1 < argc) {
+        options->record_path = argv[++*i];
+    } else if (strcmp(argv[*i], "--replay") == 0 && *i + 1 < argc) {
+        options->replay_path = argv[++*i];
+    } else if (strcmp(argv[*i], "--fast") == 0) {
+        options->replay_fast = 1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Проверка сочетания ключей после разбора
+int capture_check_options(const struct capture_options *options) {
+    if (options->record_path && options->replay_path) {
+        fprintf(stderr, "--record и --replay нельзя использовать одновременно\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Разбор --record FILE, --replay FILE, --fast для сервисов без собственных ключей
+int capture_parse_args(int argc, char **argv, struct capture_options *options) {
+    memset(options, 0, sizeof(*options));
+    for (int i = 1; i < argc; i++) {
+        if (!capture_parse_arg(argc, argv, &i, options)) {
+            fprintf(stderr, "Usage: %s [--record FILE | --replay FILE [--fast]]\n", argv[0]);
+            return -1;
+        }
+    }
+    return capture_check_options(options);
+}
+
+// Открытие файла записи на дозапись. Несколько сервисов пишут в один файл:
+// заголовок файла пишет тот, кто его создал, каждая запись уходит одним write() с O_APPEND
+int capture_open_record(struct capture *cap, const char *path) {
+    memset(cap, 0, sizeof(*cap));
+    struct capture_file_header header;
+    cap->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+    if (cap->fd != -1) {
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = CAPTURE_VERSION;
+        header.long_size = sizeof(long);
+        if (write(cap->fd, &header, sizeof(header)) != sizeof(header)) {
+            perror("Ошибка записи заголовка capture");
+            close(cap->fd);
+            cap->fd = -1;
+            return -1;
+        }
+        return 0;
+    }
+    if (errno != EEXIST) {
+        perror("Ошибка открытия файла capture");
+        return -1;
+    }
+
+    int check_fd = open(path, O_RDONLY);
+    if (check_fd == -1 || read_full(check_fd, &header, sizeof(header)) != 0 ||
+        memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.long_size != sizeof(long)) {
+        fprintf(stderr, "Файл %s не является совместимой записью capture\n", path);
+        if (check_fd != -1) close(check_fd);
+        return -1;
+    }
+    close(check_fd);
+    cap->fd = open(path, O_WRONLY | O_APPEND);
+    if (cap->fd == -1) {
+        perror("Ошибка открытия файла capture");
+        return -1;
+    }
+    return 0;
+}
+
+// Дозапись одного сообщения с меткой времени
+int capture_write(struct capture *cap, uint8_t stream, const void *data, uint32_t length) {
+    if (cap->fd == -1) {
+        return 0;
+    }
+    char record[sizeof(struct capture_record_header) + CAPTURE_MAX_PAYLOAD];
+    struct capture_record_header header = {.t_ns = monotonic_ns(), .stream = stream};
+    if (length > CAPTURE_MAX_PAYLOAD) length = CAPTURE_MAX_PAYLOAD;
+    header.length = length;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), data, length);
+
+    size_t total = sizeof(header) + length;
+    if (write(cap->fd, record, total) != (ssize_t)total) {
+        perror("Ошибка записи capture");
+        return -1;
+    }
+    cap->last_t_ns = header.t_ns;
+    cap->records++;
+    cap->bytes += total;
+    return 0;
+}
+
+// Открытие записи для воспроизведения. fast = 1 - без пауз между сообщениями
+int capture_open_replay(struct capture *cap, const char *path, int fast) {
+    memset(cap, 0, sizeof(*cap));
+    cap->replay_fast = fast;
+    cap->fd = open(path, O_RDONLY);
+    if (cap->fd == -1) {
+        perror("Ошибка открытия файла capture");
+        return -1;
+    }
+    struct capture_file_header header;
+    if (read_full(cap->fd, &header, sizeof(header)) != 0 ||
+        memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Файл %s не является записью capture\n", path);
+        capture_close(cap);
+        return -1;
+    }
+    if (header.version != CAPTURE_VERSION || header.long_size != sizeof(long)) {
+        fprintf(stderr, "Запись %s сделана на несовместимой платформе (версия %u, long %u байт)\n",
+                path, header.version, header.long_size);
+        capture_close(cap);
+        return -1;
+    }
+    return 0;
+}
+
+// Следующее сообщение потока stream. Записи других потоков пропускаются.
+// Без --fast выдерживаются исходные интервалы между записями.
+// Возвращает длину сообщения или -1 в конце записи
+ssize_t capture_next(struct capture *cap, uint8_t stream, void *buffer, size_t size) {
+    struct capture_record_header header;
+    char payload[CAPTURE_MAX_PAYLOAD];
+    for (;;) {
+        if (read_full(cap->fd, &header, sizeof(header)) != 0 || header.length > CAPTURE_MAX_PAYLOAD ||
+            read_full(cap->fd, payload, header.length) != 0) {
+            return -1;
+        }
+        if (header.stream == stream) {
+            break;
+        }
+    }
+
+    if (cap->records == 0) {
+        cap->first_t_ns = header.t_ns;
+        cap->start_ns = monotonic_ns();
+    } else if (!cap->replay_fast) {
+        uint64_t target_ns = cap->start_ns + (header.t_ns - cap->first_t_ns);
+        struct timespec target = {.tv_sec = target_ns / 1000000000ULL, .tv_nsec = target_ns % 1000000000ULL};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) == EINTR) {
+        }
+    }
+
+    cap->last_t_ns = header.t_ns;
+    size_t length = header.length < size ? header.length : size;
+    memcpy(buffer, payload, length);
+    cap->records++;
+    cap->bytes += sizeof(header) + header.length;
+    return length;
+}
+
+// Итог записи или воспроизведения: количество сообщений и пропускная способность
+void capture_report(struct capture *cap, const char *service) {
+    double elapsed_s = cap->start_ns ? (monotonic_ns() - cap->start_ns) / 1e9 : 0.0;
+    printf("[CAPTURE] %s: %lu records, %llu bytes", service, cap->records, (unsigned long long)cap->bytes);
+    if (elapsed_s > 0.0) {
+        printf(", %.3f s, %.0f records/s", elapsed_s, cap->records / elapsed_s);
+    }
+    printf("\n");
+}
+
+void capture_close(struct capture *cap) {
+    if (cap->fd != -1) {
+        close(cap->fd);
+    }
+    cap->fd = -1;
+}
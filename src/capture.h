@@ -0,0 +1,60 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CAPTURE_MAGIC "MIKBCAP1"
+#define CAPTURE_VERSION 2
+#define CAPTURE_MAX_PAYLOAD 2048
+
+// Потоки данных в файле записи
+#define CAPTURE_STREAM_UART_RX 1   // Сырые байты от SIM800 (sim_handler)
+#define CAPTURE_STREAM_UART_TX 2   // Команды на SIM800 (sim_handler)
+#define CAPTURE_STREAM_GSM 3       // level_data_t, принятые dbsearch
+#define CAPTURE_STREAM_DISPLAY 4   // tower_info_t, принятые cordcalculation
+
+// Заголовок файла. long_size нужен, чтобы не воспроизвести запись
+// с 32-битной платформы на 64-битной (msg_type в сообщениях - long)
+struct capture_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t long_size;
+};
+
+// Заголовок записи, за ним length байт полезной нагрузки
+struct capture_record_header {
+    uint64_t t_ns;       // CLOCK_MONOTONIC, общий для всех сервисов
+    uint8_t stream;
+    uint8_t reserved[3];
+    uint32_t length;
+};
+
+// Параметры командной строки: --record FILE | --replay FILE [--fast]
+struct capture_options {
+    const char *record_path;
+    const char *replay_path;
+    int replay_fast;
+};
+
+struct capture {
+    int fd;
+    int replay_fast;
+    uint64_t first_t_ns;   // Время первой воспроизведенной записи
+    uint64_t start_ns;     // Время начала воспроизведения
+    uint64_t last_t_ns;    // Метка последней записанной или воспроизведенной записи
+    unsigned long records;
+    uint64_t bytes;
+};
+
+int capture_parse_arg(int argc, char **argv, int *i, struct capture_options *options);
+int capture_check_options(const struct capture_options *options);
+int capture_parse_args(int argc, char **argv, struct capture_options *options);
+int capture_open_record(struct capture *cap, const char *path);
+int capture_write(struct capture *cap, uint8_t stream, const void *data, uint32_t length);
+int capture_open_replay(struct capture *cap, const char *path, int fast);
+ssize_t capture_next(struct capture *cap, uint8_t stream, void *buffer, size_t size);
+void capture_report(struct capture *cap, const char *service);
+void capture_close(struct capture *cap);
+
+#endif
@@ -0,0 +1,216 @@
+#include "checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+static long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static int64_t realtime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a: битый или недописанный файл не восстанавливается
+static uint32_t checksum(const void *data, size_t length) {
+    const uint8_t *p = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int write_full(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Синхронизация каталога файла, чтобы rename пережил отключение питания
+static void sync_directory(const char *path) {
+    char dir[CHECKPOINT_PATH_SIZE];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        if (len >= sizeof(dir)) return;
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Атомарная запись состояния: PATH.tmp, fsync, rename поверх PATH.
+// При сбое на любом шаге на диске остается предыдущее целое состояние.
+// Только системные вызовы, без stdio и malloc: вызывается и после готовности сервиса
+int checkpoint_save(const char *path, const void *state, size_t length) {
+    char tmp_path[CHECKPOINT_PATH_SIZE + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    struct checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.length = length;
+    header.checksum = checksum(state, length);
+    header.saved_ms = realtime_ms();
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (write_full(fd, &header, sizeof(header)) != 0 || write_full(fd, state, length) != 0 || fsync(fd) != 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    sync_directory(path);
+    return 0;
+}
+
+// Чтение состояния длины length. Возвращает 0 и возраст в секундах, если файл целый,
+// от этой же сборки и не старше CHECKPOINT_MAX_AGE_S; иначе -1, state не изменяется
+int checkpoint_load(const char *path, void *state, size_t length, double *age_s) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct checkpoint_header header;
+    char buffer[length];
+    ssize_t header_read = read(fd, &header, sizeof(header));
+    ssize_t state_read = read(fd, buffer, length);
+    char extra;
+    ssize_t extra_read = read(fd, &extra, 1);
+    close(fd);
+
+    if (header_read != sizeof(header) || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_VERSION || header.length != length ||
+        state_read != (ssize_t)length || extra_read != 0) {
+        fprintf(stderr, "[CHECKPOINT] %s: другой формат, не восстанавливается\n", path);
+        return -1;
+    }
+    if (checksum(buffer, length) != header.checksum) {
+        fprintf(stderr, "[CHECKPOINT] %s: неверная контрольная сумма\n", path);
+        return -1;
+    }
+    double age = (realtime_ms() - header.saved_ms) / 1000.0;
+    if (age < 0.0 || age > CHECKPOINT_MAX_AGE_S) {
+        printf("[CHECKPOINT] %s: состояние устарело (%.0f с)\n", path, age);
+        return -1;
+    }
+    memcpy(state, buffer, length);
+    if (age_s) *age_s = age;
+    return 0;
+}
+
+static void write_pending(struct checkpoint *cp) {
+    pthread_mutex_lock(&cp->lock);
+    int dirty = cp->dirty;
+    if (dirty) {
+        memcpy(cp->writing, cp->pending, cp->length);
+        cp->dirty = 0;
+    }
+    pthread_mutex_unlock(&cp->lock);
+    if (!dirty) {
+        return;
+    }
+
+    long start_us = monotonic_us();
+    if (checkpoint_save(cp->path, cp->writing, cp->length) != 0) {
+        cp->errors++;
+        return;
+    }
+    long write_us = monotonic_us() - start_us;
+    if (write_us > cp->write_us_max) cp->write_us_max = write_us;
+    cp->saved++;
+}
+
+// Поток записи: раз в CHECKPOINT_PERIOD_MS сохраняет состояние, если оно изменилось
+static void *writer_main(void *arg) {
+    struct checkpoint *cp = arg;
+    struct timespec period = {CHECKPOINT_PERIOD_MS / 1000, (CHECKPOINT_PERIOD_MS % 1000) * 1000000L};
+    while (cp->running) {
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &period, NULL);
+        write_pending(cp);
+    }
+    return NULL;
+}
+
+// Буферы и поток создаются при запуске, до готовности сервиса
+int checkpoint_start(struct checkpoint *cp, const char *path, size_t length) {
+    memset(cp, 0, sizeof(*cp));
+    if (strlen(path) >= sizeof(cp->path)) {
+        fprintf(stderr, "[CHECKPOINT] слишком длинный путь: %s\n", path);
+        return -1;
+    }
+    strcpy(cp->path, path);
+    cp->length = length;
+    cp->pending = calloc(2, length);
+    if (!cp->pending) {
+        fprintf(stderr, "memory allocation error\n");
+        return -1;
+    }
+    cp->writing = (char *)cp->pending + length;
+
+    pthread_mutex_init(&cp->lock, NULL);
+    cp->running = 1;
+    if (pthread_create(&cp->thread, NULL, writer_main, cp) != 0) {
+        perror("Ошибка создания потока записи состояния");
+        cp->running = 0;
+        free(cp->pending);
+        cp->pending = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Копия состояния для следующей записи; из цикла сервиса, без ввода-вывода
+void checkpoint_update(struct checkpoint *cp, const void *state) {
+    if (!cp->pending) {
+        return;
+    }
+    pthread_mutex_lock(&cp->lock);
+    memcpy(cp->pending, state, cp->length);
+    cp->dirty = 1;
+    pthread_mutex_unlock(&cp->lock);
+}
+
+// Остановка потока и запись последнего состояния
+void checkpoint_stop(struct checkpoint *cp) {
+    if (!cp->pending) {
+        return;
+    }
+    cp->running = 0;
+    pthread_join(cp->thread, NULL);
+    write_pending(cp);
+    printf("[CHECKPOINT] %s: saved=%lu errors=%lu write_max=%ldus\n",
+           cp->path, cp->saved, cp->errors, cp->write_us_max);
+    pthread_mutex_destroy(&cp->lock);
+    free(cp->pending);
+    cp->pending = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define CHECKPOINT_MAGIC "MIKBCKP1"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_PATH_SIZE 256
+#define CHECKPOINT_PERIOD_MS 1000     // Не чаще раза в секунду: fsync на eMMC занимает десятки мс
+#define CHECKPOINT_MAX_AGE_S 600      // Более старое состояние при запуске не восстанавливается
+
+// Заголовок файла состояния, за ним length байт состояния сервиса.
+// Состояние другой длины (другая сборка) не восстанавливается
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t length;
+    uint32_t checksum;         // FNV-1a состояния
+    uint32_t reserved;
+    int64_t saved_ms;          // CLOCK_REALTIME: возраст считается и после перезагрузки
+};
+
+// Фоновая запись состояния: цикл сервиса только копирует состояние в буфер,
+// файл пишет отдельный поток раз в CHECKPOINT_PERIOD_MS (tmp, fsync, rename)
+struct checkpoint {
+    char path[CHECKPOINT_PATH_SIZE];
+    size_t length;
+    void *pending;             // Последнее состояние от цикла сервиса
+    void *writing;             // Копия, которую пишет поток
+    int dirty;
+    volatile int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // Статистика
+    unsigned long saved, errors;
+    long write_us_max;
+};
+
+int checkpoint_save(const char *path, const void *state, size_t length);
+int checkpoint_load(const char *path, void *state, size_t length, double *age_s);
+
+int checkpoint_start(struct checkpoint *cp, const char *path, size_t length);
+void checkpoint_update(struct checkpoint *cp, const void *state);
+void checkpoint_stop(struct checkpoint *cp);
+
+#endif
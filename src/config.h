@@ -7,4 +7,29 @@
 /dev/ttyAMA0 | /dev/ttyAMA1 | /dev/ttyS0 | ... если подключение конкретно на устройстве
 */
 
+// Режим получения данных о вышках
+#define SIM_CENG_MODE_POLL      0       // AT+CENG=1,1 и опрос AT+CENG? сразу после каждого ответа
+#define SIM_CENG_MODE_URC       1       // AT+CENG=2,1: модем сам присылает +CENG, AT+CENG? только по таймауту
+#define SIM_CENG_MODE_ADAPTIVE  2       // AT+CENG=1,1 и опрос с интервалом по скорости и точности от cordcalculation
+#define SIM_CENG_MODE           SIM_CENG_MODE_URC
 
+#define SIM_URC_TIMEOUT_MS      1000    // Если снимок не пришел за это время, отправляем AT+CENG?
+#define SIM_CMD_TIMEOUT_MS      500     // Ожидание OK на команды настройки
+
+// Скорость, на которую переключаемся командой AT+IPR при запуске. 0 - не переключаться
+#define SIM_UART_FAST_BAUD_RATE 0
+
+#define SIM_STATS_PERIOD_S      10      // Период вывода статистики UART
+
+// Адаптивный опрос: интервал - время, за которое при текущей скорости сдвиг достигнет SIM_QUERY_DRIFT_M,
+// уменьшенный пропорционально превышению точностью SIM_QUERY_HACC_TARGET_M
+#define SIM_QUERY_MIN_INTERVAL_MS 200   // Не чаще цикла 5 Гц
+#define SIM_QUERY_LATENCY_MS    100     // Ожидаемая задержка от AT+CENG? до решения в очереди MAVLink
+// Интервал + задержка + шаг отправки MAVLINK_PERIOD_MS (200) не должны превышать MAVLINK_STALE_MS (1000),
+// иначе стоящий на месте БВС регулярно получает NO_FIX. Проверяется в cordcalculation.c
+#define SIM_QUERY_MAX_INTERVAL_MS 700
+#define SIM_QUERY_DRIFT_M       100.0   // Допустимый сдвиг между снимками, м
+#define SIM_QUERY_HACC_TARGET_M 500.0   // Точность, при которой опрос не ускоряется, м
+#define SIM_QUERY_STATIONARY_SPEED_MPS 0.5 // Скорость ниже - стоим, интервал максимальный
+#define SIM_QUERY_MAX_GROWTH    1.5     // Интервал растет не быстрее чем в 1.5 раза за решение
+#define SIM_FEEDBACK_TIMEOUT_MS 3000    // Без обратной связи дольше - опрос с минимальным интервалом
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <string.h>
@@ -8,27 +9,85 @@
 #include <time.h>
 #include <stdint.h>
 #include "geoprocessing.h"
+#include "msg_definitions.h"
+#include "ransac.h"
+#include "rtmem.h"
+#include "capture.h"
+#include "fingerprint.h"
+#include "particle.h"
+#include "mavlink.h"
+#include "checkpoint.h"
+#include "config.h"
+
+// Самый редкий адаптивный опрос модема должен давать решения чаще, чем MAVLink объявляет их устаревшими
+#if SIM_QUERY_MAX_INTERVAL_MS + SIM_QUERY_LATENCY_MS + MAVLINK_PERIOD_MS > MAVLINK_STALE_MS
+#error "SIM_QUERY_MAX_INTERVAL_MS too long for MAVLINK_STALE_MS"
+#endif
 
 #define SOCKET_PATH_DISPLAY "/tmp/display_socket"
 #define DISPLAY_COUNT 7
 #define MIN_TOWERS_REQUIRED 3
 #define LOCATION_HISTORY_SIZE 10
-#define EARTH_RADIUS 6371000.0  // Радиус Земли в метрах
 #define SIGNAL_THRESHOLD 5     // Минимальный уровень сигнала
 #define COORDINATE_CHANGE_THRESHOLD 0.00001 // Порог изменения координат для логирования
-
-typedef struct {
-    long msg_type;
-    uint16_t MCC;
-    uint16_t MNC;
-    uint32_t CID;
-    int receive_level;
-    float LAT;
-    float LONG;
-} tower_info_t;
+#define LOCATION_LOG_PATH "location_log.txt"
+#define LOG_RECORD_SIZE 128
 
 struct Location locationHistory[LOCATION_HISTORY_SIZE];
 struct Location last_logged_location = {0.0, 0.0}; // Последнее залогированное местоположение
+int location_log_fd = -1;
+
+// Вышки текущего снимка
+tower_info_t towers[DISPLAY_COUNT];
+int tower_count = 0;
+
+// Способ расчета положения (--engine)
+#define ENGINE_TRILATERATION 0   // Трилатерация по дальностям
+#define ENGINE_FINGERPRINT 1     // Поиск по БД отпечатков RxLev
+#define ENGINE_AUTO 2            // Трилатерация, при неудаче - отпечатки
+int positioning_engine = ENGINE_TRILATERATION;
+struct fp_db fingerprint_db;
+
+// Фильтр частиц (--particles): сопровождение по любому числу вышек, в том числе одной
+static struct particle_filter tracker;
+static int tracker_enabled = 0;
+static long last_snapshot_us = 0;
+
+// Выдача решений автопилоту (--mavlink), fd = -1 - выключена
+static struct mavlink_output mavlink = {.fd = -1};
+
+// Обратная связь для адаптивного опроса в sim_handler: скорость и точность после каждого снимка
+#define SPEED_SMOOTHING 0.3    // Вес нового значения в сглаживании скорости по соседним решениям
+static int control_socket = -1;
+static double motion_speed_mps = 0.0;
+static struct position_fix previous_fix;
+static long previous_fix_us = 0;
+
+// Состояние между запусками (файл CHECKPOINT_PATH): последнее решение с ковариацией,
+// скорость и вышки снимка, по которому оно получено (первая - обслуживающая)
+#define CHECKPOINT_PATH "cordcalculation.ckpt"
+#define CHECKPOINT_DRIFT_SPEED_MPS 15.0  // Не меньше этой скорости растет погрешность сохраненного решения
+struct cordcalculation_state {
+    struct position_fix fix;
+    double speed_mps;
+    int32_t cell_count;
+    tower_info_t cells[DISPLAY_COUNT];
+};
+static struct cordcalculation_state saved_state;
+static struct checkpoint checkpoint;
+static int checkpoint_enabled = 0;
+static int restored = 0;               // Сохраненное решение еще не заменено новым
+static long restored_us = 0;           // Момент загрузки и возраст состояния на этот момент
+static double restored_age_s = 0.0;
+
+// Время до первого решения от запуска сервиса и способ, которым оно получено
+static long start_us = 0;
+static int first_fix_reported = 0;
+static const char *fix_source = "none";
+
+// Запись принятых сообщений (--record) и воспроизведение (--replay)
+static struct capture recorder = {.fd = -1};
+static struct capture player = {.fd = -1};
 
 // Добавить новую координату в историю
 void update_location_history(struct Location newLocation) {
@@ -45,22 +104,34 @@ int has_significant_location_change(struct Location new_location) {
     return (lat_diff > COORDINATE_CHANGE_THRESHOLD || lon_diff > COORDINATE_CHANGE_THRESHOLD);
 }
 
+// Открытие файла лога один раз при запуске: в цикле только write() без fopen и буферов stdio
+int open_location_log(void) {
+    location_log_fd = open(LOCATION_LOG_PATH, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (location_log_fd == -1) {
+        perror("Ошибка открытия файла для логирования");
+        return -1;
+    }
+    return 0;
+}
+
 // Логирование местоположения в файл
 void log_location(struct Location location) {
-    FILE *file = fopen("location_log.txt", "a");
-    if (!file) {
-        perror("Ошибка открытия файла для логирования");
+    if (location_log_fd == -1) {
         return;
     }
 
+    char record[LOG_RECORD_SIZE];
     time_t current_time = time(NULL);
-    struct tm *time_info = localtime(&current_time);
-    fprintf(file, "%04d-%02d-%02d %02d:%02d:%02d, LAT=%.6f, LONG=%.6f\n",
-            time_info->tm_year + 1900, time_info->tm_mon + 1, time_info->tm_mday,
-            time_info->tm_hour, time_info->tm_min, time_info->tm_sec,
-            location.latitude, location.longitude);
-
-    fclose(file);
+    struct tm time_info;
+    localtime_r(&current_time, &time_info);
+    int len = snprintf(record, sizeof(record), "%04d-%02d-%02d %02d:%02d:%02d, LAT=%.6f, LONG=%.6f\n",
+                       time_info.tm_year + 1900, time_info.tm_mon + 1, time_info.tm_mday,
+                       time_info.tm_hour, time_info.tm_min, time_info.tm_sec,
+                       location.latitude, location.longitude);
+
+    if (write(location_log_fd, record, len) == -1) {
+        perror("Ошибка записи в файл лога");
+    }
     last_logged_location = location;
 }
 
@@ -69,125 +140,357 @@ void clear_tower_data(tower_info_t *towers, int towerCount) {
     memset(towers, 0, sizeof(tower_info_t) * towerCount);
 }
 
-// Преобразование градусов в радианы
-double deg_to_rad(double deg) {
-    return deg * M_PI / 180.0;
-}
+// Нет решения: координаты 0,0, точность не известна
+static const struct position_fix invalid_fix = {{0.0, 0.0}, NAN, NAN, NAN};
 
-// Преобразование радианов в градусы
-double rad_to_deg(double rad) {
-    return rad * 180.0 / M_PI;
+static int fix_is_valid(const struct position_fix *fix) {
+    return fix->location.latitude != 0.0 || fix->location.longitude != 0.0;
 }
 
-// Формула Хаверсина для вычисления расстояния между двумя точками
-double haversine(double lat1, double lon1, double lat2, double lon2) {
-    double dlat = deg_to_rad(lat2 - lat1);
-    double dlon = deg_to_rad(lon2 - lon1);
-    lat1 = deg_to_rad(lat1);
-    lat2 = deg_to_rad(lat2);
-
-    double a = sin(dlat / 2) * sin(dlat / 2) +
-               cos(lat1) * cos(lat2) * sin(dlon / 2) * sin(dlon / 2);
-    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
-    return EARTH_RADIUS * c;
+// Трилатерация с отбраковкой выбросов (ransac_solve) и вывод ее итогов.
+// Ковариация известна только после уточнения (больше трех вышек или кольцо TA)
+struct position_fix trilaterate(tower_info_t *towers, int towerCount) {
+    struct position_fix fix = invalid_fix;
+    struct ransac_solution solution;
+    int status = ransac_solve(towers, towerCount, &fix, &solution);
+    const struct ransac_stats *stats = &solution.stats;
+    printf("[RANSAC] inliers=%d/%d (valid=%d), hypotheses=%d (TA pruned %d), cpu=%ldus%s\n",
+           stats->inliers, stats->total, stats->valid, stats->hypotheses, stats->pruned, stats->cpu_us,
+           stats->budget_hit ? " [budget hit]" : "");
+    if (status != 0) {
+        if (solution.used < 3) {
+            printf("[ERROR] Not enough towers for trilateration (need at least 3, got %d)\n", solution.used);
+        } else {
+            printf("[ERROR] Degenerate tower geometry, cannot trilaterate\n");
+        }
+        return invalid_fix;
+    }
+    if (solution.iterations < 0) {
+        // Вырожденная система уточнения: остается решение по трем вышкам, точность не известна
+        printf("[DEBUG] Least squares: degenerate geometry, keeping 3-tower fix%s\n",
+               solution.constrained ? " [TA]" : "");
+    } else if (solution.iterations > 0) {
+        printf("[DEBUG] Least squares: %d iterations, sigma N=%.1fm E=%.1fm%s\n",
+               solution.iterations, sqrt(fix.cov_nn), sqrt(fix.cov_ee), solution.constrained ? " [TA]" : "");
+    }
+
+    printf("[DEBUG] LAT=%f, LONG=%f\n", fix.location.latitude, fix.location.longitude);
+    log_location(fix.location);
+    return fix;
 }
 
-// Преобразование сферических координат в трёхмерные
-void spherical_to_cartesian(double lat, double lon, double *x, double *y, double *z) {
-    lat = deg_to_rad(lat);
-    lon = deg_to_rad(lon);
-    *x = EARTH_RADIUS * cos(lat) * cos(lon);
-    *y = EARTH_RADIUS * cos(lat) * sin(lon);
-    *z = EARTH_RADIUS * sin(lat);
+// Решение по БД отпечатков RxLev: k ближайших отпечатков в группе обслуживающей вышки.
+// Разброс k ближайших принимается за радиальную СКО
+struct position_fix locate_by_fingerprint(tower_info_t *towers, int towerCount) {
+    struct fp_result result;
+    if (fp_locate(&fingerprint_db, towers, towerCount, FP_DEFAULT_K, &result) != 0) {
+        printf("[ERROR] Serving cell not found in fingerprint DB\n");
+        return invalid_fix;
+    }
+    printf("[FINGERPRINT] LAT=%f, LONG=%f, k=%d, spread=%.0fm, candidates=%u, query=%ldus\n",
+           result.latitude, result.longitude, result.k, result.spread_m, result.candidates, result.query_us);
+
+    struct position_fix fix = {{result.latitude, result.longitude}, 0.0, 0.0, 0.0};
+    fix.cov_nn = fix.cov_ee = result.spread_m * result.spread_m / 2.0;
+    log_location(fix.location);
+    return fix;
 }
 
-// Преобразование трёхмерных координат обратно в сферические
-void cartesian_to_spherical(double x, double y, double z, double *lat, double *lon) {
-    *lat = rad_to_deg(asin(z / EARTH_RADIUS));
-    *lon = rad_to_deg(atan2(y, x));
+static long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
 }
 
-// Основная функция трилатерации с отладочными сообщениями
-struct Location trilaterate(tower_info_t *towers, int towerCount) {
-    if (towerCount < 3) {
-        printf("[ERROR] Not enough towers for trilateration (need at least 3, got %d)\n", towerCount);
-        struct Location invalidLocation = {0.0, 0.0};
-        return invalidLocation;
+// Время снимка - метка маркера конца снимка в записи: при --record та же, что попадет в файл,
+// поэтому интервалы фильтра и оценка скорости с --replay --fast совпадают с исходным запуском
+static long snapshot_time_us(void) {
+    if (player.fd != -1) {
+        return player.last_t_ns / 1000;
     }
+    if (recorder.fd != -1) {
+        return recorder.last_t_ns / 1000;
+    }
+    return monotonic_us();
+}
 
-    // Координаты и расстояния
-    double x1, y1, z1, x2, y2, z2, x3, y3, z3;
-    spherical_to_cartesian(towers[0].LAT, towers[0].LONG, &x1, &y1, &z1);
-    spherical_to_cartesian(towers[1].LAT, towers[1].LONG, &x2, &y2, &z2);
-    spherical_to_cartesian(towers[2].LAT, towers[2].LONG, &x3, &y3, &z3);
-
-    double r1 = signal_to_distance(towers[0].receive_level, 1800);
-    double r2 = signal_to_distance(towers[1].receive_level, 1800);
-    double r3 = signal_to_distance(towers[2].receive_level, 1800);
+// Обновление фильтра частиц по снимку; 0 - оценка в estimate
+int update_tracker(tower_info_t *towers, int towerCount, struct pf_estimate *estimate) {
+    long now_us = snapshot_time_us();
+    double dt = last_snapshot_us ? (now_us - last_snapshot_us) / 1e6 : 0.0;
+    last_snapshot_us = now_us;
+    if (pf_update(&tracker, towers, towerCount, dt, estimate) != 0) {
+        return -1;
+    }
+    printf("[PARTICLE] LAT=%f, LONG=%f, sigma N=%.0fm E=%.0fm, speed=%.1fm/s, towers=%d, ess=%.0f%s, update=%ldus\n",
+           estimate->fix.location.latitude, estimate->fix.location.longitude,
+           sqrt(estimate->fix.cov_nn), sqrt(estimate->fix.cov_ee), estimate->speed_mps,
+           estimate->observations, estimate->ess, estimate->resampled ? " [resampled]" : "",
+           estimate->update_us);
+    return 0;
+}
 
-    //printf("[DEBUG] Cartesian coordinates:\n");
-    //printf("  Tower 1: x=%f, y=%f, z=%f, r1=%f\n", x1, y1, z1, r1);
-    //printf("  Tower 2: x=%f, y=%f, z=%f, r2=%f\n", x2, y2, z2, r2);
-    //printf("  Tower 3: x=%f, y=%f, z=%f, r3=%f\n", x3, y3, z3, r3);
+// Решение из файла состояния, пока нет своего: только если обслуживающая вышка снимка
+// была в сохраненном снимке. Погрешность растет с возрастом состояния
+static struct position_fix restored_fix(const tower_info_t *towers, int towerCount) {
+    int same_cell = 0;
+    for (int i = 0; i < saved_state.cell_count && towerCount > 0; i++) {
+        if (saved_state.cells[i].MCC == towers[0].MCC && saved_state.cells[i].MNC == towers[0].MNC &&
+            saved_state.cells[i].CID == towers[0].CID) {
+            same_cell = 1;
+        }
+    }
+    if (!same_cell) {
+        return invalid_fix;
+    }
+    double age_s = restored_age_s + (monotonic_us() - restored_us) / 1e6;
+    double drift_m = fmax(saved_state.speed_mps, CHECKPOINT_DRIFT_SPEED_MPS) * age_s;
+    struct position_fix fix = saved_state.fix;
+    if (!isfinite(fix.cov_nn) || !isfinite(fix.cov_ee)) {
+        fix.cov_nn = fix.cov_ee = fix.cov_ne = 0.0;
+    }
+    fix.cov_nn += drift_m * drift_m / 2.0;
+    fix.cov_ee += drift_m * drift_m / 2.0;
+    printf("[CHECKPOINT] saved fix LAT=%f, LONG=%f, age=%.1fs, sigma=%.0fm\n",
+           fix.location.latitude, fix.location.longitude, age_s, sqrt(fix.cov_nn + fix.cov_ee));
+    return fix;
+}
 
-    // Решение системы уравнений в 3D
-    double ex[3], ey[3], ez[3], d, i, j, x, y, z;
+// Обработка полного снимка: отбраковка выбросов и трилатерация по оставшимся вышкам
+struct position_fix process_snapshot(tower_info_t *towers, int towerCount) {
+    struct pf_estimate estimate;
+    int tracked = tracker_enabled && update_tracker(towers, towerCount, &estimate) == 0;
+
+    struct position_fix fix;
+    if (positioning_engine == ENGINE_FINGERPRINT) {
+        fix = locate_by_fingerprint(towers, towerCount);
+        fix_source = "fingerprint";
+    } else {
+        fix = trilaterate(towers, towerCount);
+        fix_source = "trilateration";
+
+        // Трилатерация не удалась (мало вышек или вырожденная геометрия) - решение по отпечаткам
+        if (positioning_engine == ENGINE_AUTO && !fix_is_valid(&fix)) {
+            fix = locate_by_fingerprint(towers, towerCount);
+            fix_source = "fingerprint";
+        }
+    }
 
-    // Вектор между первой и второй точками
-    ex[0] = x2 - x1;
-    ex[1] = y2 - y1;
-    ex[2] = z2 - z1;
-    d = sqrt(ex[0] * ex[0] + ex[1] * ex[1] + ex[2] * ex[2]);
-    //printf("[DEBUG] Distance between Tower 1 and Tower 2: d=%f\n", d);
+    // Нет и решения по отпечаткам (одна-две вышки) - оценка фильтра частиц
+    if (tracked && !fix_is_valid(&fix)) {
+        fix = estimate.fix;
+        fix_source = "particle";
+        log_location(fix.location);
+    }
 
-    for (int k = 0; k < 3; k++) ex[k] /= d;  // Нормализация
-    //printf("[DEBUG] Unit vector ex: x=%f, y=%f, z=%f\n", ex[0], ex[1], ex[2]);
+    // Своего решения еще не было - сохраненное перед перезапуском
+    if (fix_is_valid(&fix)) {
+        restored = 0;
+    } else if (restored) {
+        fix = restored_fix(towers, towerCount);
+        fix_source = "checkpoint";
+        if (fix_is_valid(&fix)) {
+            return fix;   // Не движение: скорость не обновляется
+        }
+    }
 
-    // Вектор от первой до третьей точки
-    double t3[3] = {x3 - x1, y3 - y1, z3 - z1};
-    i = ex[0] * t3[0] + ex[1] * t3[1] + ex[2] * t3[2];
-    //printf("[DEBUG] Projection of Tower 3 onto ex: i=%f\n", i);
+    // Скорость: по фильтру частиц, без него - сглаженная разность соседних решений
+    if (tracked) {
+        motion_speed_mps = estimate.speed_mps;
+    } else if (fix_is_valid(&fix)) {
+        long now_us = snapshot_time_us();
+        if (previous_fix_us) {
+            // Сдвиг в пределах погрешности двух решений за движение не считается
+            double dt = (now_us - previous_fix_us) / 1e6;
+            double shift = haversine(previous_fix.location.latitude, previous_fix.location.longitude,
+                                     fix.location.latitude, fix.location.longitude);
+            double noise = sqrt(previous_fix.cov_nn + previous_fix.cov_ee + fix.cov_nn + fix.cov_ee);
+            if (isfinite(noise)) shift = fmax(0.0, shift - noise);
+            double speed = shift / dt;
+            motion_speed_mps += SPEED_SMOOTHING * (speed - motion_speed_mps);
+        }
+        previous_fix = fix;
+        previous_fix_us = now_us;
+    }
+    return fix;
+}
 
-    // Вектор ортогонален ex
-    for (int k = 0; k < 3; k++) ey[k] = t3[k] - i * ex[k];
-    j = sqrt(ey[0] * ey[0] + ey[1] * ey[1] + ey[2] * ey[2]);
-    //printf("[DEBUG] Distance orthogonal to ex (j): j=%f\n", j);
+// Отправка скорости и точности решения в sim_handler. Если sim_handler не слушает - не ошибка
+static void send_feedback(const struct position_fix *fix) {
+    if (control_socket == -1) {
+        return;
+    }
+    feedback_t feedback = {.msg_type = MSG_TYPE_FEEDBACK, .speed_mps = motion_speed_mps};
+    if (!fix_is_valid(fix)) {
+        feedback.hacc_m = INFINITY;
+    } else {
+        feedback.hacc_m = sqrt(fix->cov_nn + fix->cov_ee);  // NAN, если ковариация не известна
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, CONTROL_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    sendto(control_socket, &feedback, sizeof(feedback), MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr));
+}
 
-    for (int k = 0; k < 3; k++) ey[k] /= j;  // Нормализация
-    //printf("[DEBUG] Unit vector ey: x=%f, y=%f, z=%f\n", ey[0], ey[1], ey[2]);
+// Накопление вышек снимка и расчет по маркеру конца снимка
+void handle_tower_message(const tower_info_t *received_msg) {
+    if (received_msg->msg_type == MSG_TYPE_TOWER) {
+        if (tower_count < DISPLAY_COUNT) {
+            towers[tower_count++] = *received_msg;
+        }
+    } else if (received_msg->msg_type == MSG_TYPE_SNAPSHOT_END && tower_count > 0) {
+        struct position_fix fix = process_snapshot(towers, tower_count);
+        struct Location final_location = fix.location;
+        if (fix_is_valid(&fix)) {
+            mavlink_publish(&mavlink, &fix, tower_count);
+        }
+        send_feedback(&fix);
 
-    // Вектор, ортогональный ex и ey
-    ez[0] = ex[1] * ey[2] - ex[2] * ey[1];
-    ez[1] = ex[2] * ey[0] - ex[0] * ey[2];
-    ez[2] = ex[0] * ey[1] - ex[1] * ey[0];
-    //printf("[DEBUG] Unit vector ez: x=%f, y=%f, z=%f\n", ez[0], ez[1], ez[2]);
+        if (fix_is_valid(&fix) && !first_fix_reported) {
+            first_fix_reported = 1;
+            printf("[TTFF] cordcalculation: first fix after %ldms (%s start, %s)\n",
+                   (monotonic_us() - start_us) / 1000, restored_us ? "warm" : "cold", fix_source);
+        }
+        // Состояние для перезапуска: копия в буфер, файл пишет поток checkpoint
+        if (checkpoint_enabled && fix_is_valid(&fix) && !restored) {
+            saved_state.fix = fix;
+            saved_state.speed_mps = motion_speed_mps;
+            saved_state.cell_count = tower_count;
+            memcpy(saved_state.cells, towers, sizeof(tower_info_t) * tower_count);
+            checkpoint_update(&checkpoint, &saved_state);
+        }
 
-    x = (r1 * r1 - r2 * r2 + d * d) / (2 * d);
-    y = (r1 * r1 - r3 * r3 + i * i + j * j) / (2 * j) - (i / j) * x;
-    z = sqrt(fabs(r1 * r1 - x * x - y * y));
+        // Логируем только при значительном изменении координат
+        if (has_significant_location_change(final_location)) {
+            update_location_history(final_location);
+            //log_location(final_location);
+        }
 
-    //printf("[DEBUG] Calculated x=%f, y=%f, z=%f\n", x, y, z);
+        // Очищаем данные для следующего расчета
+        clear_tower_data(towers, DISPLAY_COUNT);
+        tower_count = 0;
+    }
+}
 
-    // Перевод в глобальные координаты
-    double result_x = x1 + x * ex[0] + y * ey[0] + z * ez[0];
-    double result_y = y1 + x * ex[1] + y * ey[1] + z * ez[1];
-    double result_z = z1 + x * ex[2] + y * ey[2] + z * ez[2];
+int main(int argc, char **argv) {
+    rt_setup_stdio();
+    start_us = monotonic_us();
+    printf("[DEBUG] Starting console_display server...\n");
+    open_location_log();
+
+    struct capture_options capture_options = {0};
+    const char *fingerprint_path = NULL;
+    const char *engine_name = NULL;
+    int particle_count = 0;
+    const char *mavlink_target = NULL;
+    double mavlink_max_hacc_m = MAVLINK_MAX_HACC_M;
+    for (int i = 1; i < argc; i++) {
+        if (capture_parse_arg(argc, argv, &i, &capture_options)) {
+            continue;
+        } else if (strcmp(argv[i], "--fingerprint") == 0 && i + 1 < argc) {
+            fingerprint_path = argv[++i];
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            engine_name = argv[++i];
+        } else if (strcmp(argv[i], "--mavlink") == 0 && i + 1 < argc) {
+            mavlink_target = argv[++i];
+        } else if (strcmp(argv[i], "--mavlink-max-hacc") == 0 && i + 1 < argc) {
+            mavlink_max_hacc_m = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            particle_count = atoi(argv[++i]);
+            tracker_enabled = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--record FILE | --replay FILE [--fast]] [--fingerprint DB.fp] "
+                            "[--engine trilat|fingerprint|auto] [--particles N] [--mavlink udp:ADDR:PORT|TTY[:BAUD]] "
+                            "[--mavlink-max-hacc M]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (capture_check_options(&capture_options) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (!(mavlink_max_hacc_m > 0.0)) {
+        fprintf(stderr, "--mavlink-max-hacc expects a positive accuracy in meters\n");
+        exit(EXIT_FAILURE);
+    }
 
-    //printf("[DEBUG] Result Cartesian coordinates: x=%f, y=%f, z=%f\n", result_x, result_y, result_z);
+    // С БД отпечатков по умолчанию auto: отпечатки там, где трилатерация не справилась
+    if (fingerprint_path) {
+        if (fp_db_load(&fingerprint_db, fingerprint_path) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        positioning_engine = ENGINE_AUTO;
+    }
+    if (engine_name) {
+        if (strcmp(engine_name, "trilat") == 0) {
+            positioning_engine = ENGINE_TRILATERATION;
+        } else if (strcmp(engine_name, "fingerprint") == 0) {
+            positioning_engine = ENGINE_FINGERPRINT;
+        } else if (strcmp(engine_name, "auto") == 0) {
+            positioning_engine = ENGINE_AUTO;
+        } else {
+            fprintf(stderr, "Unknown engine: %s\n", engine_name);
+            exit(EXIT_FAILURE);
+        }
+        if (positioning_engine != ENGINE_TRILATERATION && !fingerprint_path) {
+            fprintf(stderr, "--engine %s requires --fingerprint DB.fp\n", engine_name);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    struct Location result;
-    cartesian_to_spherical(result_x, result_y, result_z, &result.latitude, &result.longitude);
+    // Потоки и буферы фильтра создаются до готовности сервиса: в цикле память не выделяется
+    if (tracker_enabled && pf_init(&tracker, particle_count, 0) != 0) {
+        exit(EXIT_FAILURE);
+    }
 
-    printf("[DEBUG] LAT=%f, LONG=%f\n", result.latitude, result.longitude);
-    log_location(result);
-    return result;
-}
+    control_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (control_socket == -1) {
+        perror("Ошибка создания сокета обратной связи");
+    }
 
+    // Поток отправки 5 Гц создается до готовности сервиса
+    if (mavlink_target && mavlink_open(&mavlink, mavlink_target, mavlink_max_hacc_m) != 0) {
+        exit(EXIT_FAILURE);
+    }
 
+    if (capture_options.record_path && capture_open_record(&recorder, capture_options.record_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
 
+    // Восстановление последнего решения. При воспроизведении состояние не читается и не пишется
+    if (!capture_options.replay_path) {
+        if (checkpoint_load(CHECKPOINT_PATH, &saved_state, sizeof(saved_state), &restored_age_s) == 0 &&
+            saved_state.cell_count >= 0 && saved_state.cell_count <= DISPLAY_COUNT &&
+            fix_is_valid(&saved_state.fix)) {
+            restored = 1;
+            restored_us = monotonic_us();
+            last_logged_location = saved_state.fix.location;
+            update_location_history(saved_state.fix.location);
+            motion_speed_mps = saved_state.speed_mps;
+            printf("[CHECKPOINT] restored fix LAT=%f, LONG=%f, %d cells (saved %.0fs ago)\n",
+                   saved_state.fix.location.latitude, saved_state.fix.location.longitude,
+                   saved_state.cell_count, restored_age_s);
+        } else {
+            memset(&saved_state, 0, sizeof(saved_state));
+        }
+        checkpoint_enabled = checkpoint_start(&checkpoint, CHECKPOINT_PATH, sizeof(saved_state)) == 0;
+    }
 
-int main() {
-    printf("[DEBUG] Starting console_display server...\n");
+    // Воспроизведение: вышки берутся из записи вместо сокета dbsearch
+    if (capture_options.replay_path) {
+        if (capture_open_replay(&player, capture_options.replay_path, capture_options.replay_fast) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        rt_ready("cordcalculation");
+        tower_info_t received_msg;
+        while (capture_next(&player, CAPTURE_STREAM_DISPLAY, &received_msg, sizeof(received_msg)) > 0) {
+            handle_tower_message(&received_msg);
+        }
+        capture_report(&player, "cordcalculation");
+        capture_close(&player);
+        mavlink_close(&mavlink);
+        return 0;
+    }
 
     int server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
     if (server_socket == -1) {
@@ -211,6 +514,8 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    rt_ready("cordcalculation");
+
     int client_socket = accept(server_socket, NULL, NULL);
     if (client_socket == -1) {
         perror("Ошибка подключения клиента");
@@ -218,10 +523,6 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    tower_info_t towers[DISPLAY_COUNT] = {0};
-    int tower_count = 0;
-    int is_ready_for_calculation = 0;
-
     while (1) {
         tower_info_t received_msg;
         ssize_t bytes_received = recv(client_socket, &received_msg, sizeof(received_msg), 0);
@@ -235,39 +536,8 @@ int main() {
             continue;
         }
 
-        if (received_msg.msg_type == 1) {
-            towers[tower_count++] = received_msg;
-
-            if (tower_count >= MIN_TOWERS_REQUIRED) {
-                is_ready_for_calculation = 1;
-            }
-
-            if (is_ready_for_calculation) {
-                struct Location new_location = trilaterate(towers, tower_count);
-                
-                // Логируем только при значительном изменении координат
-                if (has_significant_location_change(new_location)) {
-                    update_location_history(new_location);
-                    //log_location(new_location);
-                }
-
-                // Очищаем данные для следующего расчета
-                clear_tower_data(towers, DISPLAY_COUNT);
-                tower_count = 0;
-                is_ready_for_calculation = 0;
-            }
-        } else if (received_msg.msg_type == 2) {
-            struct Location final_location = trilaterate(towers, tower_count);
-
-            if (has_significant_location_change(final_location)) {
-                update_location_history(final_location);
-                //log_location(final_location);
-            }
-
-            clear_tower_data(towers, DISPLAY_COUNT);
-            tower_count = 0;
-            is_ready_for_calculation = 0;
-        }
+        capture_write(&recorder, CAPTURE_STREAM_DISPLAY, &received_msg, sizeof(received_msg));
+        handle_tower_message(&received_msg);
     }
 
     close(client_socket);
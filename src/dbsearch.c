@@ -3,42 +3,275 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include "hashutils.h"
 #include "msg_definitions.h"
+#include "rtmem.h"
+#include "capture.h"
+#include "checkpoint.h"
 
 #define SOCKET_PATH "/tmp/gsm_socket"
 #define SOCKET_PATH_DISPLAY "/tmp/display_socket"
+#define DB_PATH "250.csv"
+#define CHECKPOINT_PATH "dbsearch.ckpt"
+#define HOT_TOWER_COUNT 64     // Недавно найденных вышек в состоянии: ~10 снимков по 7 вышек с запасом
 
-struct display_message {
-    long msg_type;
+size_t DBSIZE;
+
+// Недавно найденные вышки. Сохраняются в файл состояния и при запуске отвечают на запросы,
+// пока полная БД загружается в фоновом потоке
+struct hot_tower {
     uint16_t MCC;
     uint16_t MNC;
     uint32_t CID;
-    int receive_level;
-    float LAT;
-    float LONG;
+    float LAT, LONG;
+    uint32_t last_used;    // Счетчик обращений: вытесняется вышка с наименьшим
 };
 
-size_t DBSIZE;
+struct dbsearch_state {
+    uint32_t count;
+    uint32_t clock;
+    struct hot_tower towers[HOT_TOWER_COUNT];
+};
+
+static struct dbsearch_state hot;
+static struct checkpoint checkpoint;
+static int checkpoint_enabled = 0;
+
+// Полная БД: таблица выделяется до готовности сервиса (loading_table), поток загрузки
+// заполняет ее и публикует указатель в hash_table, до этого NULL
+static struct Node **loading_table = NULL;
+static struct Node **hash_table = NULL;
+static pthread_t loader_thread;
+
+// Время до готовности БД и сколько запросов за это время обслужено из сохраненных вышек.
+// Счетчики пишет цикл запросов, а читает поток загрузки - только через __atomic
+static long start_ms;
+static unsigned long hot_hits = 0, hot_misses = 0;
+
+// Запись принятых сообщений (--record)
+static struct capture recorder = {.fd = -1};
+
+// Сокет для передачи данных в cordcalculation
+static int display_socket = -1;
+
+// Подключение к сокету cordcalculation
+int connect_display(void) {
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        perror("Ошибка создания сокета для console_display");
+        return -1;
+    }
+
+    struct sockaddr_un display_addr;
+    memset(&display_addr, 0, sizeof(display_addr));
+    display_addr.sun_family = AF_UNIX;
+    strncpy(display_addr.sun_path, SOCKET_PATH_DISPLAY, sizeof(display_addr.sun_path) - 1);
 
-int main() {
-    char *file = "250.csv";
-    DBSIZE = count_db_lines(file);
-    struct Node **hash_table = (struct Node **)calloc(DBSIZE, sizeof(struct Node));
-    if (!hash_table) {
+    if (connect(sock, (struct sockaddr*)&display_addr, sizeof(display_addr)) == -1) {
+        perror("Ошибка соединения с сокетом console_display");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Отправка в cordcalculation. Если он был перезапущен, переподключаемся и повторяем один раз
+int send_display(const tower_info_t *msg) {
+    if (display_socket != -1 && send(display_socket, msg, sizeof(*msg), MSG_NOSIGNAL) != -1) {
+        return 0;
+    }
+    if (display_socket != -1) {
+        close(display_socket);
+    }
+    display_socket = connect_display();
+    if (display_socket == -1) {
+        return -1;
+    }
+    printf("Reconnected to console_display\n");
+    return send(display_socket, msg, sizeof(*msg), MSG_NOSIGNAL) == -1 ? -1 : 0;
+}
+
+static long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static struct hot_tower *hot_lookup(uint16_t MCC, uint16_t MNC, uint32_t CID) {
+    for (uint32_t i = 0; i < hot.count; i++) {
+        if (hot.towers[i].MCC == MCC && hot.towers[i].MNC == MNC && hot.towers[i].CID == CID) {
+            return &hot.towers[i];
+        }
+    }
+    return NULL;
+}
+
+// Отметка об использовании найденной вышки; новая вытесняет давно не встречавшуюся
+static void hot_touch(uint16_t MCC, uint16_t MNC, uint32_t CID, float LAT, float LONG) {
+    struct hot_tower *tower = hot_lookup(MCC, MNC, CID);
+    if (!tower) {
+        if (hot.count < HOT_TOWER_COUNT) {
+            tower = &hot.towers[hot.count++];
+        } else {
+            tower = &hot.towers[0];
+            for (uint32_t i = 1; i < hot.count; i++) {
+                if (hot.towers[i].last_used < tower->last_used) tower = &hot.towers[i];
+            }
+        }
+        tower->MCC = MCC;
+        tower->MNC = MNC;
+        tower->CID = CID;
+    }
+    tower->LAT = LAT;
+    tower->LONG = LONG;
+    tower->last_used = ++hot.clock;
+}
+
+// Без БД сервис не работает: завершаемся с ошибкой, launcher перезапустит сервис
+static void db_load_failed(const char *file) {
+    fprintf(stderr, "[TTFF] dbsearch: DB %s failed to load after %ldms\n", file, monotonic_ms() - start_ms);
+    exit(EXIT_FAILURE);
+}
+
+// Пул узлов и таблица на верхнюю оценку числа вышек по размеру файла: выделяются
+// до готовности сервиса, как и вся остальная память
+static void allocate_db(const char *file) {
+    size_t capacity = db_capacity(file);
+    if (capacity == 0 || init_node_pool(capacity) != 0) {
+        db_load_failed(file);
+    }
+    loading_table = (struct Node **)calloc(capacity, sizeof(struct Node *));
+    if (!loading_table) {
         perror("Failed to allocate memory for hash table");
-        exit(EXIT_FAILURE);
+        db_load_failed(file);
     }
-    parse_and_insert_db(file, hash_table);
+    DBSIZE = capacity;
+}
+
+// Загрузка полной БД в фоновом потоке: сервис уже отвечает по сохраненным вышкам.
+// Память выделена заранее (allocate_db), поток только разбирает файл
+static void *load_db(void *arg) {
+    const char *file = arg;
+    long towers = parse_and_insert_db(file, loading_table);
+    if (towers < 0) {
+        db_load_failed(file);
+    }
+
+    long db_ready_ms = monotonic_ms() - start_ms;
+    __atomic_store_n(&hash_table, loading_table, __ATOMIC_RELEASE);
     printf("Hash table created and waiting for requests...\n");
+    printf("[TTFF] dbsearch: DB ready after %ldms (%ld towers), served from saved towers: %lu found, %lu missed\n",
+           db_ready_ms, towers, __atomic_load_n(&hot_hits, __ATOMIC_RELAXED),
+           __atomic_load_n(&hot_misses, __ATOMIC_RELAXED));
+    return NULL;
+}
+
+// Поиск вышки в БД и пересылка результата в cordcalculation
+void handle_level_data(const level_data_t *level_data) {
+    // Конец снимка пересылаем дальше, чтобы cordcalculation начал расчет
+    if (level_data->msg_type == MSG_TYPE_SNAPSHOT_END) {
+        if (checkpoint_enabled) {
+            checkpoint_update(&checkpoint, &hot);
+        }
+        tower_info_t end_msg = {.msg_type = MSG_TYPE_SNAPSHOT_END};
+        if (send_display(&end_msg) == -1) {
+            perror("Ошибка отправки конечного сигнала через сокет display");
+        }
+        return;
+    }
+
+    printf("Received data: MCC=%d, MNC=%d, CID=%u, receive_level=%d, TA=%d\n",
+           level_data->MCC, level_data->MNC, level_data->CID, level_data->receive_level, level_data->TA);
+
+    tower_info_t msg = {
+        .msg_type = MSG_TYPE_TOWER,
+        .MCC = level_data->MCC,
+        .MNC = level_data->MNC,
+        .CID = level_data->CID,
+        .receive_level = level_data->receive_level,
+        .TA = level_data->TA,
+        .LAT = 0.0,
+        .LONG = 0.0
+    };
+    struct Node **table = __atomic_load_n(&hash_table, __ATOMIC_ACQUIRE);
+    if (table) {
+        struct Node *result = search_in_hash_table(table, level_data->MCC, level_data->MNC, level_data->CID);
+        if (result) {
+            msg.LAT = result->LAT;
+            msg.LONG = result->LONG;
+        }
+    } else {
+        // БД еще загружается: ответ по сохраненным вышкам
+        struct hot_tower *tower = hot_lookup(level_data->MCC, level_data->MNC, level_data->CID);
+        if (tower) {
+            msg.LAT = tower->LAT;
+            msg.LONG = tower->LONG;
+            __atomic_fetch_add(&hot_hits, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&hot_misses, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (msg.LAT != 0.0 || msg.LONG != 0.0) {
+        hot_touch(msg.MCC, msg.MNC, msg.CID, msg.LAT, msg.LONG);
+    }
+
+    if (send_display(&msg) == -1) {
+        perror("Ошибка отправки данных через сокет display");
+    } else {
+        printf("Sent to console_display: LAT=%.6f, LONG=%.6f\n", msg.LAT, msg.LONG);
+    }
+}
+
+int main(int argc, char **argv) {
+    rt_setup_stdio();
+
+    struct capture_options capture_options;
+    if (capture_parse_args(argc, argv, &capture_options) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (capture_options.record_path && capture_open_record(&recorder, capture_options.record_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    start_ms = monotonic_ms();
+
+    // Вышки из файла состояния отвечают на запросы, пока полная БД загружается.
+    // При воспроизведении состояние не читается и не пишется: результат зависит только от записи
+    if (!capture_options.replay_path) {
+        double age_s;
+        if (checkpoint_load(CHECKPOINT_PATH, &hot, sizeof(hot), &age_s) == 0 && hot.count <= HOT_TOWER_COUNT) {
+            printf("[CHECKPOINT] restored %u towers (saved %.0fs ago)\n", hot.count, age_s);
+        } else {
+            memset(&hot, 0, sizeof(hot));
+        }
+        checkpoint_enabled = checkpoint_start(&checkpoint, CHECKPOINT_PATH, sizeof(hot)) == 0;
+    }
+    allocate_db(DB_PATH);
+
+    // Поток загрузки создается с обычным планированием, а не с унаследованным SCHED_FIFO сервиса:
+    // иначе разбор БД на том же ядре и с тем же приоритетом не дает циклу запросов выполняться
+    pthread_attr_t loader_attr;
+    struct sched_param loader_param = {.sched_priority = 0};
+    pthread_attr_init(&loader_attr);
+    pthread_attr_setinheritsched(&loader_attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&loader_attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&loader_attr, &loader_param);
+    int loader_error = pthread_create(&loader_thread, &loader_attr, load_db, DB_PATH);
+    pthread_attr_destroy(&loader_attr);
+    if (loader_error != 0) {
+        fprintf(stderr, "Ошибка создания потока загрузки БД: %s\n", strerror(loader_error));
+        exit(EXIT_FAILURE);
+    }
 
     // Создаем серверный сокет
     int server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
     if (server_socket == -1) {
         perror("socket creation failed");
-        free(hash_table);
         exit(EXIT_FAILURE);
     }
 
@@ -51,37 +284,43 @@ int main() {
     if (bind(server_socket, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
         perror("bind failed");
         close(server_socket);
-        free(hash_table);
         exit(EXIT_FAILURE);
     }
 
     if (listen(server_socket, 5) == -1) {
         perror("listen failed");
         close(server_socket);
-        free(hash_table);
         exit(EXIT_FAILURE);
     }
 
     // Создаем клиентский сокет для передачи данных в console_display
-    int display_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    display_socket = connect_display();
     if (display_socket == -1) {
-        perror("Ошибка создания сокета для console_display");
-        free(hash_table);
         close(server_socket);
         exit(EXIT_FAILURE);
     }
 
-    struct sockaddr_un display_addr;
-    memset(&display_addr, 0, sizeof(display_addr));
-    display_addr.sun_family = AF_UNIX;
-    strncpy(display_addr.sun_path, SOCKET_PATH_DISPLAY, sizeof(display_addr.sun_path) - 1);
+    rt_ready("dbsearch");
 
-    if (connect(display_socket, (struct sockaddr*)&display_addr, sizeof(display_addr)) == -1) {
-        perror("Ошибка соединения с сокетом console_display");
+    // Воспроизведение: запросы берутся из записи вместо сокета sim_handler.
+    // Ответы не должны зависеть от скорости загрузки, поэтому сначала дожидаемся полной БД
+    if (capture_options.replay_path) {
+        pthread_join(loader_thread, NULL);
+        struct capture player;
+        if (capture_open_replay(&player, capture_options.replay_path, capture_options.replay_fast) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        level_data_t level_data;
+        while (capture_next(&player, CAPTURE_STREAM_GSM, &level_data, sizeof(level_data)) > 0) {
+            handle_level_data(&level_data);
+        }
+        capture_report(&player, "dbsearch");
+        capture_close(&player);
         close(display_socket);
-        free(hash_table);
+        if (hash_table) free_hash_table(hash_table, DBSIZE);
         close(server_socket);
-        exit(EXIT_FAILURE);
+        unlink(SOCKET_PATH);
+        return 0;
     }
 
     while (1) {
@@ -92,12 +331,7 @@ int main() {
         }
 
         while (1) {
-            struct {
-                uint16_t MCC;
-                uint16_t MNC;
-                uint32_t CID;
-                int receive_level;
-            } level_data;
+            level_data_t level_data;
 
             ssize_t bytes_received = recv(client_socket, &level_data, sizeof(level_data), 0);
             if (bytes_received == -1) {
@@ -108,37 +342,22 @@ int main() {
                 break;
             }
 
-            printf("Received data: MCC=%d, MNC=%d, CID=%u, receive_level=%d\n",
-                   level_data.MCC, level_data.MNC, level_data.CID, level_data.receive_level);
-
-            struct Node *result = search_in_hash_table(hash_table, level_data.MCC, level_data.MNC, level_data.CID);
-            struct display_message msg = {
-                .msg_type = 1,
-                .MCC = level_data.MCC,
-                .MNC = level_data.MNC,
-                .CID = level_data.CID,
-                .receive_level = level_data.receive_level,
-                .LAT = result ? result->LAT : 0.0,
-                .LONG = result ? result->LONG : 0.0
-            };
-
-            if (send(display_socket, &msg, sizeof(msg), 0) == -1) {
-                perror("Ошибка отправки данных через сокет display");
-            } else {
-                printf("Sent to console_display: LAT=%.6f, LONG=%.6f\n", msg.LAT, msg.LONG);
-            }
+            capture_write(&recorder, CAPTURE_STREAM_GSM, &level_data, sizeof(level_data));
+            handle_level_data(&level_data);
         }
 
         // Отправка сигнала окончания передачи
-        struct display_message end_msg = {.msg_type = 2, .MCC = 0, .MNC = 0, .CID = 0, .receive_level = 0, .LAT = 0.0, .LONG = 0.0};
-        if (send(display_socket, &end_msg, sizeof(end_msg), 0) == -1) {
+        tower_info_t end_msg = {.msg_type = MSG_TYPE_SNAPSHOT_END, .MCC = 0, .MNC = 0, .CID = 0, .receive_level = 0, .LAT = 0.0, .LONG = 0.0};
+        if (send_display(&end_msg) == -1) {
             perror("Ошибка отправки конечного сигнала через сокет display");
         }
         close(client_socket);
     }
 
     close(display_socket); // Закрываем сокет display при завершении
-    free(hash_table);
+    if (checkpoint_enabled) checkpoint_stop(&checkpoint);
+    pthread_join(loader_thread, NULL);
+    if (hash_table) free_hash_table(hash_table, DBSIZE);
     close(server_socket);
     unlink(SOCKET_PATH);
     return 0;
@@ -0,0 +1,254 @@
+#include "fingerprint.h"
+#include "geoprocessing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// Векторные типы GCC: один и тот же код собирается в SSE2 на x86 и в NEON на ARM
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+typedef int8_t i8x16 __attribute__((vector_size(16)));
+typedef uint16_t u16x16 __attribute__((vector_size(32)));
+
+static long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+int fp_tower_compare(const struct fp_tower *a, const struct fp_tower *b) {
+    if (a->MCC != b->MCC) return a->MCC < b->MCC ? -1 : 1;
+    if (a->MNC != b->MNC) return a->MNC < b->MNC ? -1 : 1;
+    if (a->CID != b->CID) return a->CID < b->CID ? -1 : 1;
+    return 0;
+}
+
+// Область count элементов по item_size байт со смещения offset лежит внутри файла и выровнена
+static int region_ok(uint64_t offset, uint64_t count, size_t item_size, uint64_t file_size) {
+    if (offset % item_size != 0 || offset > file_size) return 0;
+    return count <= (file_size - offset) / item_size;
+}
+
+// Проверка заголовка и групп: поиск обращается к файлу только по проверенным здесь смещениям,
+// поэтому испорченный файл с верным заголовком не выводит чтение за пределы буфера,
+// а число столбцов группы - за пределы вектора запроса
+static int validate_db(const struct fp_db *db) {
+    const struct fp_file_header *h = db->header;
+    uint64_t size = h->file_size;
+    if (!region_ok(h->towers_offset, h->tower_count, sizeof(struct fp_tower), size) ||
+        !region_ok(h->groups_offset, h->group_count, sizeof(struct fp_group), size) ||
+        !region_ok(h->columns_offset, h->column_total, sizeof(uint32_t), size) ||
+        !region_ok(h->lat_offset, h->entry_total, sizeof(float), size) ||
+        !region_ok(h->lon_offset, h->entry_total, sizeof(float), size) ||
+        h->rxlev_offset > size) {
+        return -1;
+    }
+    const struct fp_group *groups = (const struct fp_group *)(db->data + h->groups_offset);
+    const uint32_t *columns = (const uint32_t *)(db->data + h->columns_offset);
+    uint64_t rxlev_size = size - h->rxlev_offset;
+    for (uint32_t i = 0; i < h->group_count; i++) {
+        const struct fp_group *g = &groups[i];
+        if (g->serving >= h->tower_count || g->column_count > FP_MAX_COLUMNS ||
+            (uint64_t)g->first_entry + g->entry_count > h->entry_total ||
+            g->stride < g->entry_count || g->stride % FP_LANES != 0 ||
+            (uint64_t)g->first_column + g->column_count > h->column_total ||
+            g->rxlev_offset > rxlev_size ||
+            (uint64_t)g->column_count * g->stride > rxlev_size - g->rxlev_offset) {
+            return -1;
+        }
+        for (uint32_t c = 0; c < g->column_count; c++) {
+            if (columns[g->first_column + c] >= h->tower_count) return -1;
+        }
+    }
+    return 0;
+}
+
+// Загрузка БД целиком в память. Вызывается до rt_ready(), дальше поиск без выделений
+int fp_db_load(struct fp_db *db, const char *filename) {
+    memset(db, 0, sizeof(*db));
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Cant open file: %s\n", filename);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct fp_file_header)) {
+        fprintf(stderr, "Fingerprint DB %s is too short\n", filename);
+        close(fd);
+        return -1;
+    }
+    db->data = aligned_alloc(64, (st.st_size + 63) & ~63UL);
+    if (!db->data) {
+        fprintf(stderr, "memory allocation error\n");
+        close(fd);
+        return -1;
+    }
+    size_t done = 0;
+    while (done < (size_t)st.st_size) {
+        ssize_t n = read(fd, db->data + done, st.st_size - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    close(fd);
+
+    db->header = (const struct fp_file_header *)db->data;
+    if (done != (size_t)st.st_size || memcmp(db->header->magic, FP_MAGIC, 8) != 0 ||
+        db->header->version != FP_VERSION || db->header->file_size != (uint64_t)st.st_size ||
+        validate_db(db) != 0) {
+        fprintf(stderr, "Fingerprint DB %s is damaged or has wrong version\n", filename);
+        fp_db_free(db);
+        return -1;
+    }
+    db->towers = (const struct fp_tower *)(db->data + db->header->towers_offset);
+    db->groups = (const struct fp_group *)(db->data + db->header->groups_offset);
+    db->columns = (const uint32_t *)(db->data + db->header->columns_offset);
+    db->lat = (const float *)(db->data + db->header->lat_offset);
+    db->lon = (const float *)(db->data + db->header->lon_offset);
+    db->rxlev = (const uint8_t *)(db->data + db->header->rxlev_offset);
+    printf("Fingerprint DB %s: %u towers, %u groups, %u fingerprints\n", filename,
+           db->header->tower_count, db->header->group_count, db->header->entry_total);
+    return 0;
+}
+
+void fp_db_free(struct fp_db *db) {
+    free(db->data);
+    memset(db, 0, sizeof(*db));
+}
+
+// Индекс вышки в словаре (двоичный поиск) или -1
+int64_t fp_find_tower(const struct fp_db *db, uint16_t MCC, uint16_t MNC, uint32_t CID) {
+    struct fp_tower key = {MCC, MNC, CID};
+    int64_t lo = 0, hi = (int64_t)db->header->tower_count - 1;
+    while (lo <= hi) {
+        int64_t mid = (lo + hi) / 2;
+        int cmp = fp_tower_compare(&db->towers[mid], &key);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1; else hi = mid - 1;
+    }
+    return -1;
+}
+
+// Группа отпечатков обслуживающей вышки (двоичный поиск) или NULL
+static const struct fp_group *find_group(const struct fp_db *db, uint32_t serving) {
+    int64_t lo = 0, hi = (int64_t)db->header->group_count - 1;
+    while (lo <= hi) {
+        int64_t mid = (lo + hi) / 2;
+        uint32_t value = db->groups[mid].serving;
+        if (value == serving) return &db->groups[mid];
+        if (value < serving) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Векторное ядро: dist[e] += |q - column[e]| для блока из count отпечатков (count кратно FP_LANES)
+static void accumulate_column(uint16_t *dist, const uint8_t *column, uint8_t q, uint32_t count) {
+    u8x16 qv = (u8x16){0} + q;
+    for (uint32_t e = 0; e < count; e += FP_LANES) {
+        u8x16 m;
+        u16x16 acc;
+        memcpy(&m, column + e, sizeof(m));
+        memcpy(&acc, dist + e, sizeof(acc));
+        u8x16 greater = (u8x16)(m > qv);
+        u8x16 diff = ((m - qv) & greater) | ((qv - m) & ~greater);
+        acc += __builtin_convertvector(diff, u16x16);
+        memcpy(dist + e, &acc, sizeof(acc));
+    }
+}
+
+// Поиск k ближайших отпечатков по RxLev среди группы обслуживающей вышки (towers[0]).
+// Возвращает 0 и оценку положения в result или -1, если вышки нет в БД
+int fp_locate(const struct fp_db *db, const tower_info_t *towers, int count, int k, struct fp_result *result) {
+    long start_us = monotonic_us();
+    memset(result, 0, sizeof(*result));
+    if (!db->data || count <= 0) {
+        return -1;
+    }
+    if (k < 1) k = 1;
+    if (k > FP_MAX_K) k = FP_MAX_K;
+
+    int64_t serving = fp_find_tower(db, towers[0].MCC, towers[0].MNC, towers[0].CID);
+    const struct fp_group *group = serving >= 0 ? find_group(db, (uint32_t)serving) : NULL;
+    if (!group) {
+        result->query_us = monotonic_us() - start_us;
+        return -1;
+    }
+
+    // Вектор запроса в столбцах группы; вышки снимка, которых нет в группе, не влияют на порядок
+    uint8_t query[FP_MAX_COLUMNS];
+    int64_t tower_index[LSQ_MAX_TOWERS];
+    int observed = count < LSQ_MAX_TOWERS ? count : LSQ_MAX_TOWERS;
+    for (int i = 0; i < observed; i++) {
+        tower_index[i] = fp_find_tower(db, towers[i].MCC, towers[i].MNC, towers[i].CID);
+    }
+    const uint32_t *columns = db->columns + group->first_column;
+    for (uint32_t c = 0; c < group->column_count; c++) {
+        query[c] = FP_RXLEV_NOT_HEARD;
+        for (int i = 0; i < observed; i++) {
+            if (tower_index[i] == columns[c]) {
+                int level = towers[i].receive_level;
+                query[c] = level < 0 ? 0 : (level > 63 ? 63 : level);
+            }
+        }
+    }
+
+    // Блоками по FP_BLOCK: расстояния блока остаются в L1, столбцы читаются последовательно
+    uint16_t dist[FP_BLOCK] __attribute__((aligned(32)));
+    uint32_t best_index[FP_MAX_K];
+    uint16_t best_dist[FP_MAX_K];
+    int found = 0;
+    const uint8_t *matrix = db->rxlev + group->rxlev_offset;
+    for (uint32_t base = 0; base < group->stride; base += FP_BLOCK) {
+        uint32_t block = group->stride - base < FP_BLOCK ? group->stride - base : FP_BLOCK;
+        memset(dist, 0, block * sizeof(uint16_t));
+        for (uint32_t c = 0; c < group->column_count; c++) {
+            accumulate_column(dist, matrix + (size_t)c * group->stride + base, query[c], block);
+        }
+
+        uint32_t valid = group->entry_count - base < block ? group->entry_count - base : block;
+        for (uint32_t e = 0; e < valid; e++) {
+            uint16_t d = dist[e];
+            if (found == k && d >= best_dist[k - 1]) continue;
+            int pos = found < k ? found++ : k - 1;
+            while (pos > 0 && best_dist[pos - 1] > d) {
+                best_dist[pos] = best_dist[pos - 1];
+                best_index[pos] = best_index[pos - 1];
+                pos--;
+            }
+            best_dist[pos] = d;
+            best_index[pos] = group->first_entry + base + e;
+        }
+    }
+    if (found == 0) {
+        result->query_us = monotonic_us() - start_us;
+        return -1;
+    }
+
+    // Положение - среднее k ближайших с весами 1/(d+1)
+    double weight_sum = 0.0, lat = 0.0, lon = 0.0;
+    for (int i = 0; i < found; i++) {
+        double w = 1.0 / (best_dist[i] + 1.0);
+        lat += w * db->lat[best_index[i]];
+        lon += w * db->lon[best_index[i]];
+        weight_sum += w;
+    }
+    lat /= weight_sum;
+    lon /= weight_sum;
+    double spread = 0.0;
+    for (int i = 0; i < found; i++) {
+        double w = 1.0 / (best_dist[i] + 1.0);
+        double d = haversine(lat, lon, db->lat[best_index[i]], db->lon[best_index[i]]);
+        spread += w * d * d;
+    }
+
+    result->latitude = lat;
+    result->longitude = lon;
+    result->spread_m = sqrt(spread / weight_sum);
+    result->candidates = group->entry_count;
+    result->best_distance = best_dist[0];
+    result->k = found;
+    result->query_us = monotonic_us() - start_us;
+    return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "msg_definitions.h"
+
+#define FP_MAGIC "MIKBFP01"
+#define FP_VERSION 1
+#define FP_LANES 16              // Ширина векторного ядра: отпечатков за одну операцию
+#define FP_BLOCK 1024            // Отпечатков в блоке: расстояния блока помещаются в L1
+#define FP_MAX_K 8
+#define FP_DEFAULT_K 4
+#define FP_MAX_COLUMNS 1024      // Предел вышек в группе: сумма |dRxLev| помещается в uint16
+#define FP_RXLEV_NOT_HEARD 0     // Вышка не слышна в точке отпечатка
+
+// Формат файла БД отпечатков (все смещения от начала файла, выравнивание 16 байт):
+//   fp_file_header
+//   fp_tower[tower_count]          - словарь вышек, отсортирован по (MCC, MNC, CID)
+//   fp_group[group_count]          - группы по обслуживающей вышке, отсортированы по serving
+//   uint32_t columns[column_total] - вышки-столбцы каждой группы (индексы в словаре)
+//   float lat[entry_total], lon[entry_total] - координаты отпечатков (структура массивов)
+//   uint8_t rxlev[...]             - RxLev по столбцам: для группы column_count строк по stride байт
+struct fp_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tower_count;
+    uint32_t group_count;
+    uint32_t column_total;
+    uint32_t entry_total;
+    uint32_t reserved;
+    uint64_t towers_offset;
+    uint64_t groups_offset;
+    uint64_t columns_offset;
+    uint64_t lat_offset;
+    uint64_t lon_offset;
+    uint64_t rxlev_offset;
+    uint64_t file_size;
+};
+
+struct fp_tower {
+    uint16_t MCC;
+    uint16_t MNC;
+    uint32_t CID;
+};
+
+struct fp_group {
+    uint32_t serving;        // Индекс обслуживающей вышки в словаре
+    uint32_t first_entry;    // Первый отпечаток группы в lat/lon
+    uint32_t entry_count;
+    uint32_t stride;         // entry_count, дополненный до кратного FP_LANES
+    uint32_t first_column;
+    uint32_t column_count;
+    uint64_t rxlev_offset;   // Смещение матрицы группы от rxlev_offset файла
+};
+
+// Загруженная БД: файл целиком в одном буфере, выделенном при запуске
+struct fp_db {
+    char *data;
+    const struct fp_file_header *header;
+    const struct fp_tower *towers;
+    const struct fp_group *groups;
+    const uint32_t *columns;
+    const float *lat;
+    const float *lon;
+    const uint8_t *rxlev;
+};
+
+// Результат поиска
+struct fp_result {
+    double latitude;
+    double longitude;
+    double spread_m;         // Взвешенный разброс k ближайших, м
+    uint32_t candidates;     // Отпечатков в группе обслуживающей вышки
+    uint16_t best_distance;  // Сумма |dRxLev| ближайшего отпечатка
+    uint8_t k;
+    long query_us;
+};
+
+int fp_db_load(struct fp_db *db, const char *filename);
+void fp_db_free(struct fp_db *db);
+int64_t fp_find_tower(const struct fp_db *db, uint16_t MCC, uint16_t MNC, uint32_t CID);
+int fp_locate(const struct fp_db *db, const tower_info_t *towers, int count, int k, struct fp_result *result);
+int fp_tower_compare(const struct fp_tower *a, const struct fp_tower *b);
+
+#endif
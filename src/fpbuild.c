@@ -0,0 +1,479 @@
+// fpbuild.c - построение БД отпечатков RxLev для fingerprint.c и замер скорости поиска
+//   fpbuild SAMPLES.csv OUT.fp                - по записанным полетам
+//   fpbuild --synthetic 250.csv FLIGHTS OUT.fp - по синтетическим полетам над вышками из БД
+//   fpbuild --bench DB.fp QUERIES             - время и ошибка поиска на зашумленных отпечатках самой БД
+// Строка SAMPLES.csv: LAT,LONG,MCC,MNC,CID,RXLEV[,MCC,MNC,CID,RXLEV]... первая вышка - обслуживающая
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "fingerprint.h"
+#include "geoprocessing.h"
+
+#define GRID_DEG 0.0005                // Ячейка сетки отпечатков, ~50 м по широте
+#define MAX_SAMPLE_TOWERS 7
+#define SYNTH_BUCKET_DEG 0.05          // Ячейка индекса вышек для синтетики
+#define SYNTH_FLIGHT_SAMPLES 500       // Точек в одном синтетическом полете
+#define SYNTH_STEP_M 20.0              // Шаг между точками полета
+#define SYNTH_START_RADIUS_M 3000.0    // Старт полета не дальше от случайной вышки
+#define SYNTH_MAX_RANGE_M 15000.0      // Дальше вышка не слышна
+#define SYNTH_RXLEV_1KM 45.0           // RxLev на 1 км, модель с показателем затухания 3.5
+#define SYNTH_PATH_LOSS_EXP 3.5
+#define SYNTH_NOISE_RXLEV 3.0          // СКО шума RxLev
+#define BENCH_NOISE_RXLEV 3
+
+struct sample {
+    float lat, lon;
+    int32_t cell_lat, cell_lon;
+    uint8_t n;
+    struct fp_tower towers[MAX_SAMPLE_TOWERS];
+    uint8_t rxlev[MAX_SAMPLE_TOWERS];
+    uint16_t merged;   // Сколько замеров усреднено в этой записи
+};
+
+static struct sample *samples;
+static size_t sample_count, sample_capacity;
+
+static struct sample *new_sample(void) {
+    if (sample_count == sample_capacity) {
+        sample_capacity = sample_capacity ? sample_capacity * 2 : 4096;
+        samples = realloc(samples, sample_capacity * sizeof(*samples));
+        if (!samples) {
+            fprintf(stderr, "memory allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct sample *s = &samples[sample_count++];
+    memset(s, 0, sizeof(*s));
+    s->merged = 1;
+    return s;
+}
+
+static uint8_t clamp_rxlev(double level) {
+    if (level < 0) return 0;
+    if (level > 63) return 63;
+    return (uint8_t)lround(level);
+}
+
+// Гауссов шум (Бокс-Мюллер)
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+// Соседние вышки отпечатка упорядочены, чтобы одинаковые наборы давали одинаковый ключ
+static void canonicalize(struct sample *s) {
+    for (int i = 2; i < s->n; i++) {
+        for (int j = i; j > 1 && fp_tower_compare(&s->towers[j - 1], &s->towers[j]) > 0; j--) {
+            struct fp_tower t = s->towers[j]; s->towers[j] = s->towers[j - 1]; s->towers[j - 1] = t;
+            uint8_t r = s->rxlev[j]; s->rxlev[j] = s->rxlev[j - 1]; s->rxlev[j - 1] = r;
+        }
+    }
+    s->cell_lat = (int32_t)floor(s->lat / GRID_DEG);
+    s->cell_lon = (int32_t)floor(s->lon / GRID_DEG);
+}
+
+// Ключ отпечатка: обслуживающая вышка, ячейка сетки, набор соседей
+static int sample_compare(const void *pa, const void *pb) {
+    const struct sample *a = pa, *b = pb;
+    int cmp = fp_tower_compare(&a->towers[0], &b->towers[0]);
+    if (cmp) return cmp;
+    if (a->cell_lat != b->cell_lat) return a->cell_lat < b->cell_lat ? -1 : 1;
+    if (a->cell_lon != b->cell_lon) return a->cell_lon < b->cell_lon ? -1 : 1;
+    if (a->n != b->n) return a->n < b->n ? -1 : 1;
+    for (int i = 1; i < a->n; i++) {
+        cmp = fp_tower_compare(&a->towers[i], &b->towers[i]);
+        if (cmp) return cmp;
+    }
+    return 0;
+}
+
+static int tower_sort_compare(const void *a, const void *b) {
+    return fp_tower_compare(a, b);
+}
+
+static int u32_compare(const void *pa, const void *pb) {
+    uint32_t a = *(const uint32_t *)pa, b = *(const uint32_t *)pb;
+    return a < b ? -1 : (a > b);
+}
+
+// Чтение записанных полетов
+static int load_samples(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Cant open file: %s\n", filename);
+        return -1;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        float lat, lon;
+        int offset;
+        if (sscanf(line, "%f,%f%n", &lat, &lon, &offset) != 2) continue;
+        struct sample *s = new_sample();
+        s->lat = lat;
+        s->lon = lon;
+        char *p = line + offset;
+        unsigned mcc, mnc, cid;
+        int level, used;
+        while (s->n < MAX_SAMPLE_TOWERS && sscanf(p, ",%u,%u,%u,%d%n", &mcc, &mnc, &cid, &level, &used) == 4) {
+            s->towers[s->n] = (struct fp_tower){mcc, mnc, cid};
+            s->rxlev[s->n] = clamp_rxlev(level);
+            s->n++;
+            p += used;
+        }
+        if (s->n == 0) sample_count--;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Вышки из БД в формате 250.csv для синтетики
+struct synth_tower {
+    struct fp_tower id;
+    float lat, lon;
+    int64_t bucket;
+};
+
+static int64_t bucket_key(double lat, double lon) {
+    return (int64_t)floor(lat / SYNTH_BUCKET_DEG) * 100000 + (int64_t)floor(lon / SYNTH_BUCKET_DEG);
+}
+
+static int synth_tower_compare(const void *pa, const void *pb) {
+    const struct synth_tower *a = pa, *b = pb;
+    return a->bucket < b->bucket ? -1 : (a->bucket > b->bucket);
+}
+
+// Синтетические полеты: случайный старт около случайной вышки, случайное блуждание курса,
+// уровни по модели затухания с показателем SYNTH_PATH_LOSS_EXP и гауссовым шумом
+static int generate_synthetic(const char *db_file, long flights) {
+    FILE *file = fopen(db_file, "r");
+    if (!file) {
+        fprintf(stderr, "Cant open file: %s\n", db_file);
+        return -1;
+    }
+    size_t count = 0, capacity = 1024;
+    struct synth_tower *towers = malloc(capacity * sizeof(*towers));
+    char line[256];
+    while (towers && fgets(line, sizeof(line), file)) {
+        uint16_t MCC, MNC, LAC;
+        uint32_t CID;
+        float LAT, LON;
+        if (sscanf(line, "%*[^,],%hu,%hu,%hu,%u,%*d,%f,%f", &MCC, &MNC, &LAC, &CID, &LON, &LAT) != 6) continue;
+        if (count == capacity) {
+            capacity *= 2;
+            towers = realloc(towers, capacity * sizeof(*towers));
+            if (!towers) break;
+        }
+        towers[count++] = (struct synth_tower){{MCC, MNC, CID}, LAT, LON, bucket_key(LAT, LON)};
+    }
+    fclose(file);
+    if (!towers || count == 0) {
+        fprintf(stderr, "No towers in %s\n", db_file);
+        return -1;
+    }
+    qsort(towers, count, sizeof(*towers), synth_tower_compare);
+
+    for (long f = 0; f < flights; f++) {
+        const struct synth_tower *start = &towers[rand() % count];
+        double heading = 2 * M_PI * rand() / RAND_MAX;
+        double offset = SYNTH_START_RADIUS_M * sqrt((double)rand() / RAND_MAX);
+        double lat = start->lat + offset * cos(heading) / 111195.0;
+        double lon = start->lon + offset * sin(heading) / (111195.0 * cos(deg_to_rad(start->lat)));
+
+        for (int step = 0; step < SYNTH_FLIGHT_SAMPLES; step++) {
+            heading += deg_to_rad(10.0) * gaussian();
+            lat += SYNTH_STEP_M * cos(heading) / 111195.0;
+            lon += SYNTH_STEP_M * sin(heading) / (111195.0 * cos(deg_to_rad(lat)));
+
+            // Ближайшие вышки из 3x3 ячеек индекса
+            struct { double level; const struct synth_tower *t; } heard[MAX_SAMPLE_TOWERS];
+            int heard_count = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    struct synth_tower key = {.bucket = bucket_key(lat + dy * SYNTH_BUCKET_DEG, lon + dx * SYNTH_BUCKET_DEG)};
+                    size_t lo = 0, hi = count;
+                    while (lo < hi) {
+                        size_t mid = (lo + hi) / 2;
+                        if (towers[mid].bucket < key.bucket) lo = mid + 1; else hi = mid;
+                    }
+                    for (size_t i = lo; i < count && towers[i].bucket == key.bucket; i++) {
+                        double d = haversine(lat, lon, towers[i].lat, towers[i].lon);
+                        if (d > SYNTH_MAX_RANGE_M) continue;
+                        if (d < 10.0) d = 10.0;
+                        double level = SYNTH_RXLEV_1KM - 10.0 * SYNTH_PATH_LOSS_EXP * log10(d / 1000.0)
+                                       + SYNTH_NOISE_RXLEV * gaussian();
+                        int pos;
+                        if (heard_count < MAX_SAMPLE_TOWERS) {
+                            pos = heard_count++;
+                        } else if (level > heard[MAX_SAMPLE_TOWERS - 1].level) {
+                            pos = MAX_SAMPLE_TOWERS - 1;
+                        } else {
+                            continue;
+                        }
+                        while (pos > 0 && heard[pos - 1].level < level) {
+                            heard[pos] = heard[pos - 1];
+                            pos--;
+                        }
+                        heard[pos].level = level;
+                        heard[pos].t = &towers[i];
+                    }
+                }
+            }
+            if (heard_count == 0) continue;
+
+            struct sample *s = new_sample();
+            s->lat = lat;
+            s->lon = lon;
+            for (int i = 0; i < heard_count; i++) {
+                s->towers[i] = heard[i].t->id;
+                s->rxlev[i] = clamp_rxlev(heard[i].level);
+            }
+            s->n = heard_count;
+        }
+    }
+    free(towers);
+    return 0;
+}
+
+// Слияние замеров с одинаковым ключом: усреднение координат и уровней
+static size_t merge_samples(void) {
+    for (size_t i = 0; i < sample_count; i++) canonicalize(&samples[i]);
+    qsort(samples, sample_count, sizeof(*samples), sample_compare);
+
+    size_t out = 0;
+    for (size_t i = 0; i < sample_count; i++) {
+        if (out > 0 && sample_compare(&samples[out - 1], &samples[i]) == 0) {
+            struct sample *m = &samples[out - 1];
+            double w = m->merged;
+            m->lat = (m->lat * w + samples[i].lat) / (w + 1);
+            m->lon = (m->lon * w + samples[i].lon) / (w + 1);
+            for (int t = 0; t < m->n; t++) {
+                m->rxlev[t] = clamp_rxlev((m->rxlev[t] * w + samples[i].rxlev[t]) / (w + 1));
+            }
+            if (m->merged < UINT16_MAX) m->merged++;
+        } else {
+            samples[out++] = samples[i];
+        }
+    }
+    sample_count = out;
+    return out;
+}
+
+static uint64_t align16(uint64_t offset) {
+    return (offset + 15) & ~15ULL;
+}
+
+// Запись БД: словарь вышек, группы по обслуживающей вышке, SoA координат, матрицы RxLev
+static int write_db(const char *filename) {
+    // Словарь всех вышек
+    size_t tower_capacity = sample_count * MAX_SAMPLE_TOWERS;
+    struct fp_tower *dict = malloc((tower_capacity ? tower_capacity : 1) * sizeof(*dict));
+    size_t tower_count = 0;
+    for (size_t i = 0; i < sample_count; i++) {
+        for (int t = 0; t < samples[i].n; t++) dict[tower_count++] = samples[i].towers[t];
+    }
+    qsort(dict, tower_count, sizeof(*dict), tower_sort_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < tower_count; i++) {
+        if (unique == 0 || fp_tower_compare(&dict[unique - 1], &dict[i]) != 0) dict[unique++] = dict[i];
+    }
+    tower_count = unique;
+
+    struct fp_db lookup = {.towers = dict};
+    struct fp_file_header header = {.tower_count = tower_count};
+    lookup.header = &header;
+
+    // Группы: замеры уже отсортированы по обслуживающей вышке
+    size_t group_capacity = 1024, group_count = 0;
+    struct fp_group *groups = malloc(group_capacity * sizeof(*groups));
+    uint32_t *columns = malloc(1024 * sizeof(*columns));
+    size_t column_total = 0, column_capacity = 1024;
+    uint64_t rxlev_size = 0;
+    uint32_t *scratch = malloc(MAX_SAMPLE_TOWERS * sizeof(uint32_t) * (sample_count ? sample_count : 1));
+
+    for (size_t first = 0; first < sample_count;) {
+        size_t last = first;
+        while (last < sample_count && fp_tower_compare(&samples[last].towers[0], &samples[first].towers[0]) == 0) last++;
+
+        size_t n = 0;
+        for (size_t i = first; i < last; i++) {
+            for (int t = 0; t < samples[i].n; t++) {
+                scratch[n++] = (uint32_t)fp_find_tower(&lookup, samples[i].towers[t].MCC,
+                                                       samples[i].towers[t].MNC, samples[i].towers[t].CID);
+            }
+        }
+        qsort(scratch, n, sizeof(uint32_t), u32_compare);
+        size_t cols = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (cols == 0 || scratch[cols - 1] != scratch[i]) scratch[cols++] = scratch[i];
+        }
+        if (cols > FP_MAX_COLUMNS) {
+            fprintf(stderr, "Group with %zu towers truncated to %d\n", cols, FP_MAX_COLUMNS);
+            cols = FP_MAX_COLUMNS;
+        }
+
+        if (group_count == group_capacity) {
+            group_capacity *= 2;
+            groups = realloc(groups, group_capacity * sizeof(*groups));
+        }
+        while (column_total + cols > column_capacity) {
+            column_capacity *= 2;
+            columns = realloc(columns, column_capacity * sizeof(*columns));
+        }
+        if (!groups || !columns) {
+            fprintf(stderr, "memory allocation error\n");
+            return -1;
+        }
+        memcpy(columns + column_total, scratch, cols * sizeof(uint32_t));
+
+        struct fp_group *g = &groups[group_count++];
+        g->serving = (uint32_t)fp_find_tower(&lookup, samples[first].towers[0].MCC,
+                                             samples[first].towers[0].MNC, samples[first].towers[0].CID);
+        g->first_entry = first;
+        g->entry_count = last - first;
+        g->stride = (g->entry_count + FP_LANES - 1) / FP_LANES * FP_LANES;
+        g->first_column = column_total;
+        g->column_count = cols;
+        g->rxlev_offset = rxlev_size;
+        rxlev_size += align16((uint64_t)cols * g->stride);
+        column_total += cols;
+        first = last;
+    }
+
+    header.group_count = group_count;
+    header.column_total = column_total;
+    header.entry_total = sample_count;
+    memcpy(header.magic, FP_MAGIC, 8);
+    header.version = FP_VERSION;
+    header.towers_offset = align16(sizeof(header));
+    header.groups_offset = align16(header.towers_offset + tower_count * sizeof(struct fp_tower));
+    header.columns_offset = align16(header.groups_offset + group_count * sizeof(struct fp_group));
+    header.lat_offset = align16(header.columns_offset + column_total * sizeof(uint32_t));
+    header.lon_offset = align16(header.lat_offset + sample_count * sizeof(float));
+    header.rxlev_offset = align16(header.lon_offset + sample_count * sizeof(float));
+    header.file_size = header.rxlev_offset + rxlev_size;
+
+    char *data = calloc(1, header.file_size);
+    if (!data) {
+        fprintf(stderr, "memory allocation error\n");
+        return -1;
+    }
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + header.towers_offset, dict, tower_count * sizeof(struct fp_tower));
+    memcpy(data + header.groups_offset, groups, group_count * sizeof(struct fp_group));
+    memcpy(data + header.columns_offset, columns, column_total * sizeof(uint32_t));
+    float *lat = (float *)(data + header.lat_offset);
+    float *lon = (float *)(data + header.lon_offset);
+    for (size_t i = 0; i < sample_count; i++) {
+        lat[i] = samples[i].lat;
+        lon[i] = samples[i].lon;
+    }
+    for (size_t gi = 0; gi < group_count; gi++) {
+        const struct fp_group *g = &groups[gi];
+        uint8_t *matrix = (uint8_t *)(data + header.rxlev_offset + g->rxlev_offset);
+        const uint32_t *group_columns = columns + g->first_column;
+        for (uint32_t e = 0; e < g->entry_count; e++) {
+            const struct sample *s = &samples[g->first_entry + e];
+            for (int t = 0; t < s->n; t++) {
+                uint32_t id = (uint32_t)fp_find_tower(&lookup, s->towers[t].MCC, s->towers[t].MNC, s->towers[t].CID);
+                uint32_t *col = bsearch(&id, group_columns, g->column_count, sizeof(uint32_t), u32_compare);
+                if (col) matrix[(size_t)(col - group_columns) * g->stride + e] = s->rxlev[t];
+            }
+        }
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file || fwrite(data, 1, header.file_size, file) != header.file_size) {
+        fprintf(stderr, "Cant write file: %s\n", filename);
+        if (file) fclose(file);
+        return -1;
+    }
+    fclose(file);
+    printf("Written %s: %zu towers, %zu groups, %zu fingerprints, %.1f MB\n", filename,
+           tower_count, group_count, sample_count, header.file_size / 1048576.0);
+    free(data);
+    free(scratch);
+    free(columns);
+    free(groups);
+    free(dict);
+    return 0;
+}
+
+static int compare_long(const void *pa, const void *pb) {
+    long a = *(const long *)pa, b = *(const long *)pb;
+    return a < b ? -1 : (a > b);
+}
+
+// Замер: запросы из случайных отпечатков БД с шумом RxLev, время поиска и ошибка положения
+static int bench(const char *filename, long queries) {
+    struct fp_db db;
+    if (fp_db_load(&db, filename) != 0) return -1;
+    if (db.header->entry_total == 0 || queries <= 0) return -1;
+
+    long *times = malloc(queries * sizeof(long));
+    double error_sum = 0.0;
+    long located = 0;
+    uint64_t candidates = 0;
+    for (long q = 0; q < queries; q++) {
+        const struct fp_group *g = &db.groups[rand() % db.header->group_count];
+        uint32_t e = rand() % g->entry_count;
+        tower_info_t towers[MAX_SAMPLE_TOWERS];
+        int n = 0;
+        towers[n++] = (tower_info_t){.MCC = db.towers[g->serving].MCC, .MNC = db.towers[g->serving].MNC,
+                                     .CID = db.towers[g->serving].CID};
+        const uint8_t *matrix = db.rxlev + g->rxlev_offset;
+        for (uint32_t c = 0; c < g->column_count; c++) {
+            uint8_t level = matrix[(size_t)c * g->stride + e];
+            if (level == FP_RXLEV_NOT_HEARD) continue;
+            const struct fp_tower *t = &db.towers[db.columns[g->first_column + c]];
+            int noisy = level + rand() % (2 * BENCH_NOISE_RXLEV + 1) - BENCH_NOISE_RXLEV;
+            if (db.columns[g->first_column + c] == g->serving) {
+                towers[0].receive_level = noisy;
+            } else if (n < MAX_SAMPLE_TOWERS) {
+                towers[n++] = (tower_info_t){.MCC = t->MCC, .MNC = t->MNC, .CID = t->CID, .receive_level = noisy};
+            }
+        }
+        struct fp_result result;
+        if (fp_locate(&db, towers, n, FP_DEFAULT_K, &result) == 0) {
+            located++;
+            candidates += result.candidates;
+            error_sum += haversine(result.latitude, result.longitude,
+                                   db.lat[g->first_entry + e], db.lon[g->first_entry + e]);
+        }
+        times[q] = result.query_us;
+    }
+    qsort(times, queries, sizeof(long), compare_long);
+    double mean = 0.0;
+    for (long q = 0; q < queries; q++) mean += times[q];
+    printf("[BENCH] %ld queries: mean %.1f us, p99 %ld us, max %ld us, mean candidates %.0f, mean error %.1f m\n",
+           queries, mean / queries, times[queries * 99 / 100], times[queries - 1],
+           located ? (double)candidates / located : 0.0, located ? error_sum / located : 0.0);
+    free(times);
+    fp_db_free(&db);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    srand(1);
+    if (argc == 4 && strcmp(argv[1], "--bench") == 0) {
+        return bench(argv[2], atol(argv[3])) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    const char *out;
+    if (argc == 5 && strcmp(argv[1], "--synthetic") == 0) {
+        if (generate_synthetic(argv[2], atol(argv[3])) != 0) return EXIT_FAILURE;
+        out = argv[4];
+    } else if (argc == 3) {
+        if (load_samples(argv[1]) != 0) return EXIT_FAILURE;
+        out = argv[2];
+    } else {
+        fprintf(stderr, "Usage: %s SAMPLES.csv OUT.fp\n"
+                        "       %s --synthetic 250.csv FLIGHTS OUT.fp\n"
+                        "       %s --bench DB.fp QUERIES\n", argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    printf("%zu samples\n", sample_count);
+    printf("%zu fingerprints after merging by grid cell and tower set\n", merge_samples());
+    return write_db(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -14,17 +14,20 @@ uint8_t parse_ceng_response(char *response, struct celltower *towers) {
         printf("Parsing line: %s\n", line); 
 
         if (count == 0 && strstr(line, "+CENG: 0") != NULL) {
-            int tempMCC, tempMNC, tempLAC, tempCID, tempLevel;
-            if (sscanf(line, "+CENG: 0,\"%*[^,],%d,%*[^,],%d,%d,%*d,%d,%*[^,],%*[^,],%x",
-                       &tempLevel, &tempMCC, &tempMNC, &tempLAC, &tempCID) == 5) {
+            int tempMCC, tempMNC, tempLAC, tempCID, tempLevel, tempTA;
+            int fields = sscanf(line, "+CENG: 0,\"%*[^,],%d,%*[^,],%d,%d,%*d,%d,%*[^,],%*[^,],%x,%d",
+                                &tempLevel, &tempMCC, &tempMNC, &tempLAC, &tempCID, &tempTA);
+            if (fields >= 5) {
                 towers[count].MCC = tempMCC;
                 towers[count].MNC = tempMNC;
                 towers[count].LAC = tempLAC;
                 towers[count].CID = tempCID;
                 towers[count].RECEIVELEVEL = tempLevel;
+                // TA - последнее поле строки обслуживающей вышки
+                towers[count].TA = (fields == 6 && tempTA >= 0 && tempTA <= TA_MAX) ? tempTA : TA_UNKNOWN;
                 count++;
-                printf("Parsed main tower: MCC=%d, MNC=%d, LAC=%d, CID=%d, RECEIVELEVEL=%d\n",
-                       tempMCC, tempMNC, tempLAC, tempCID, tempLevel);
+                printf("Parsed main tower: MCC=%d, MNC=%d, LAC=%d, CID=%d, RECEIVELEVEL=%d, TA=%d\n",
+                       tempMCC, tempMNC, tempLAC, tempCID, tempLevel, towers[count - 1].TA);
             } else {
                 printf("Failed to parse main tower.\n"); 
             }
@@ -39,6 +42,7 @@ uint8_t parse_ceng_response(char *response, struct celltower *towers) {
                     towers[count].LAC = tempLAC;
                     towers[count].CID = tempCID;
                     towers[count].RECEIVELEVEL = tempLevel;
+                    towers[count].TA = TA_UNKNOWN;
                     count++;
                     printf("Parsed tower: MCC=%d, MNC=%d, LAC=%d, CID=%d, RECEIVELEVEL=%d\n",
                            tempMCC, tempMNC, tempLAC, tempCID, tempLevel);
@@ -132,3 +136,209 @@ struct Location trilaterate(struct celltower *towers, uint8_t towerCount, struct
     return (struct Location){totalY, totalX};
 }
 */
+
+// Преобразование градусов в радианы
+double deg_to_rad(double deg) {
+    return deg * M_PI / 180.0;
+}
+
+// Преобразование радианов в градусы
+double rad_to_deg(double rad) {
+    return rad * 180.0 / M_PI;
+}
+
+// Формула Хаверсина для вычисления расстояния между двумя точками
+double haversine(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = deg_to_rad(lat2 - lat1);
+    double dlon = deg_to_rad(lon2 - lon1);
+    lat1 = deg_to_rad(lat1);
+    lat2 = deg_to_rad(lat2);
+
+    double a = sin(dlat / 2) * sin(dlat / 2) +
+               cos(lat1) * cos(lat2) * sin(dlon / 2) * sin(dlon / 2);
+    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    return EARTH_RADIUS * c;
+}
+
+// Преобразование сферических координат в трёхмерные
+void spherical_to_cartesian(double lat, double lon, double *x, double *y, double *z) {
+    lat = deg_to_rad(lat);
+    lon = deg_to_rad(lon);
+    *x = EARTH_RADIUS * cos(lat) * cos(lon);
+    *y = EARTH_RADIUS * cos(lat) * sin(lon);
+    *z = EARTH_RADIUS * sin(lat);
+}
+
+// Преобразование трёхмерных координат обратно в сферические.
+// Точка вне сферы проецируется на нее по радиусу (asin(z / R) для нее не определен)
+void cartesian_to_spherical(double x, double y, double z, double *lat, double *lon) {
+    *lat = rad_to_deg(atan2(z, sqrt(x * x + y * y)));
+    *lon = rad_to_deg(atan2(y, x));
+}
+
+// Трилатерация по трем вышкам (пересечение трех сфер).
+// Возвращает -1, если вышки совпадают или лежат на одной прямой.
+int trilaterate_3(const double lat[3], const double lon[3], const double r[3], struct Location *out) {
+    double x1, y1, z1, x2, y2, z2, x3, y3, z3;
+    spherical_to_cartesian(lat[0], lon[0], &x1, &y1, &z1);
+    spherical_to_cartesian(lat[1], lon[1], &x2, &y2, &z2);
+    spherical_to_cartesian(lat[2], lon[2], &x3, &y3, &z3);
+
+    double ex[3], ey[3], ez[3], d, i, j, x, y, z;
+
+    // Вектор между первой и второй точками
+    ex[0] = x2 - x1;
+    ex[1] = y2 - y1;
+    ex[2] = z2 - z1;
+    d = sqrt(ex[0] * ex[0] + ex[1] * ex[1] + ex[2] * ex[2]);
+    if (d < TRILATERATION_MIN_BASE) {
+        return -1;
+    }
+    for (int k = 0; k < 3; k++) ex[k] /= d;  // Нормализация
+
+    // Вектор от первой до третьей точки
+    double t3[3] = {x3 - x1, y3 - y1, z3 - z1};
+    i = ex[0] * t3[0] + ex[1] * t3[1] + ex[2] * t3[2];
+
+    // Вектор ортогонален ex
+    for (int k = 0; k < 3; k++) ey[k] = t3[k] - i * ex[k];
+    j = sqrt(ey[0] * ey[0] + ey[1] * ey[1] + ey[2] * ey[2]);
+    if (j < TRILATERATION_MIN_BASE) {
+        return -1;
+    }
+    for (int k = 0; k < 3; k++) ey[k] /= j;  // Нормализация
+
+    // Вектор, ортогональный ex и ey
+    ez[0] = ex[1] * ey[2] - ex[2] * ey[1];
+    ez[1] = ex[2] * ey[0] - ex[0] * ey[2];
+    ez[2] = ex[0] * ey[1] - ex[1] * ey[0];
+
+    x = (r[0] * r[0] - r[1] * r[1] + d * d) / (2 * d);
+    y = (r[0] * r[0] - r[2] * r[2] + i * i + j * j) / (2 * j) - (i / j) * x;
+    z = sqrt(fabs(r[0] * r[0] - x * x - y * y));
+
+    // Перевод в глобальные координаты
+    double result_x = x1 + x * ex[0] + y * ey[0] + z * ez[0];
+    double result_y = y1 + x * ex[1] + y * ey[1] + z * ez[1];
+    double result_z = z1 + x * ex[2] + y * ey[2] + z * ez[2];
+
+    cartesian_to_spherical(result_x, result_y, result_z, &out->latitude, &out->longitude);
+    return 0;
+}
+
+// Кольцо дальности по Timing Advance: TA шагов по TA_STEP_M, [TA * шаг, (TA + 1) * шаг].
+// Возвращает -1, если TA не известен
+int ta_to_annulus(uint8_t TA, double *min_m, double *max_m) {
+    if (TA == TA_UNKNOWN || TA > TA_MAX) {
+        return -1;
+    }
+    *min_m = TA * TA_STEP_M;
+    *max_m = (TA + 1) * TA_STEP_M;
+    return 0;
+}
+
+// Дальность вышки tower, приведенная в кольцо ограничения, если оно задано для этой вышки
+double clamp_range(double r, const struct range_constraint *constraint, int tower) {
+    if (!constraint || constraint->tower != tower) {
+        return r;
+    }
+    if (r < constraint->min_m) return constraint->min_m;
+    if (r > constraint->max_m) return constraint->max_m;
+    return r;
+}
+
+// Перенос точки (pn, pe) на ближайшую точку кольца вокруг вышки (tn, te)
+static void project_to_annulus(double *pn, double *pe, double tn, double te,
+                               const struct range_constraint *constraint) {
+    double dn = *pn - tn, de = *pe - te;
+    double dist = sqrt(dn * dn + de * de);
+    double target = clamp_range(dist, constraint, constraint->tower);
+    if (target == dist) {
+        return;
+    }
+    if (dist < 1e-3) {
+        // Точка в центре кольца: направление не определено, уходим на север
+        *pn = tn + target;
+        *pe = te;
+        return;
+    }
+    *pn = tn + dn * target / dist;
+    *pe = te + de * target / dist;
+}
+
+// Уточнение положения методом Гаусса-Ньютона по всем вышкам.
+// Решается в локальной касательной плоскости вокруг начального приближения fix->location,
+// по итогу в fix записывается положение и его ковариация (м^2). constraint (может быть NULL) -
+// кольцо TA: после каждого шага точка проецируется на него, что сужает поиск и сокращает итерации.
+// Возвращает количество выполненных итераций или -1 при вырожденной геометрии.
+int refine_least_squares(const double *lat, const double *lon, const double *r, int count,
+                         const struct range_constraint *constraint, struct position_fix *fix) {
+    double lat0 = fix->location.latitude;
+    double lon0 = fix->location.longitude;
+    double m_per_deg_lat = deg_to_rad(1.0) * EARTH_RADIUS;
+    double m_per_deg_lon = m_per_deg_lat * cos(deg_to_rad(lat0));
+
+    double tn[LSQ_MAX_TOWERS], te[LSQ_MAX_TOWERS];
+    if (count > LSQ_MAX_TOWERS) count = LSQ_MAX_TOWERS;
+    for (int k = 0; k < count; k++) {
+        tn[k] = (lat[k] - lat0) * m_per_deg_lat;
+        te[k] = (lon[k] - lon0) * m_per_deg_lon;
+    }
+
+    // Проекция текущей точки на кольцо TA: дальность до вышки ограничивается [min_m, max_m]
+    int constrained = constraint && constraint->tower >= 0 && constraint->tower < count;
+    double pn = 0.0, pe = 0.0;
+    if (constrained) {
+        project_to_annulus(&pn, &pe, tn[constraint->tower], te[constraint->tower], constraint);
+    }
+    double a_nn = 0.0, a_ne = 0.0, a_ee = 0.0, sse = 0.0;
+    int iter;
+    for (iter = 1; iter <= LSQ_MAX_ITERATIONS; iter++) {
+        double g_n = 0.0, g_e = 0.0;
+        a_nn = a_ne = a_ee = sse = 0.0;
+        for (int k = 0; k < count; k++) {
+            double dn = pn - tn[k];
+            double de = pe - te[k];
+            double dist = sqrt(dn * dn + de * de);
+            if (dist < 1e-3) dist = 1e-3;
+            double jn = dn / dist, je = de / dist;
+            double res = dist - r[k];
+            a_nn += jn * jn;
+            a_ne += jn * je;
+            a_ee += je * je;
+            g_n += jn * res;
+            g_e += je * res;
+            sse += res * res;
+        }
+        double det = a_nn * a_ee - a_ne * a_ne;
+        if (fabs(det) < 1e-9) {
+            return -1;
+        }
+        double step_n = -(a_ee * g_n - a_ne * g_e) / det;
+        double step_e = -(a_nn * g_e - a_ne * g_n) / det;
+        double prev_n = pn, prev_e = pe;
+        pn += step_n;
+        pe += step_e;
+        if (constrained) {
+            project_to_annulus(&pn, &pe, tn[constraint->tower], te[constraint->tower], constraint);
+        }
+        // Сходимость по фактическому смещению (после проекции на кольцо)
+        step_n = pn - prev_n;
+        step_e = pe - prev_e;
+        if (sqrt(step_n * step_n + step_e * step_e) < LSQ_STEP_TOLERANCE) {
+            break;
+        }
+    }
+    if (iter > LSQ_MAX_ITERATIONS) iter = LSQ_MAX_ITERATIONS;
+
+    // Ковариация: s^2 * (J^T J)^-1, s^2 - дисперсия невязок
+    double det = a_nn * a_ee - a_ne * a_ne;
+    double s2 = (count > 2) ? sse / (count - 2) : sse;
+    fix->cov_nn = s2 * a_ee / det;
+    fix->cov_ne = -s2 * a_ne / det;
+    fix->cov_ee = s2 * a_nn / det;
+
+    fix->location.latitude = lat0 + pn / m_per_deg_lat;
+    fix->location.longitude = lon0 + pe / m_per_deg_lon;
+    return iter;
+}
@@ -5,6 +5,16 @@
 #include <stdlib.h>
 #include "hashutils.h"
 #include <math.h>
+
+#define EARTH_RADIUS 6371000.0        // Радиус Земли в метрах
+#define TRILATERATION_MIN_BASE 1.0    // Минимальное расстояние между вышками, м
+#define LSQ_MAX_TOWERS 7              // Максимум вышек в одном снимке AT+CENG?
+#define LSQ_MAX_ITERATIONS 10         // Предел итераций Гаусса-Ньютона
+#define LSQ_STEP_TOLERANCE 0.1        // Шаг, при котором считаем решение сошедшимся, м
+#define TA_UNKNOWN 0xFF               // Timing Advance не известен (соседние вышки)
+#define TA_MAX 63                     // Максимальное значение TA в GSM
+#define TA_STEP_M 550.0               // Один шаг TA - 553.5 м задержки в оба конца, округлено
+
 // Структуры данных
 /*
 struct coords {
@@ -19,16 +29,40 @@ struct Location {
     double longitude;
 };
 
+// Решение навигационной задачи с оценкой точности
+struct position_fix {
+    struct Location location;
+    double cov_nn, cov_ne, cov_ee;    // Ковариация положения (север/восток), м^2
+};
+
 struct celltower {
     uint16_t MCC;      // Код страны
     uint16_t MNC;      // Код оператора
     uint16_t LAC;      // Код региона
     uint32_t CID;      // CellID
     int16_t RECEIVELEVEL;
+    uint8_t TA;        // Timing Advance обслуживающей вышки, TA_UNKNOWN для соседних
+};
+
+// Жесткое ограничение дальности до одной вышки: кольцо [min_m, max_m] (по TA обслуживающей вышки)
+struct range_constraint {
+    int tower;         // Индекс вышки во входных массивах, -1 - ограничения нет
+    double min_m;
+    double max_m;
 };
 
 double signal_to_distance(int16_t RECEIVELEVEL, double frequency);
 uint8_t parse_ceng_response(char *response, struct celltower *towers);
+double deg_to_rad(double deg);
+double rad_to_deg(double rad);
+double haversine(double lat1, double lon1, double lat2, double lon2);
+void spherical_to_cartesian(double lat, double lon, double *x, double *y, double *z);
+void cartesian_to_spherical(double x, double y, double z, double *lat, double *lon);
+int trilaterate_3(const double lat[3], const double lon[3], const double r[3], struct Location *out);
+int refine_least_squares(const double *lat, const double *lon, const double *r, int count,
+                         const struct range_constraint *constraint, struct position_fix *fix);
+int ta_to_annulus(uint8_t TA, double *min_m, double *max_m);
+double clamp_range(double r, const struct range_constraint *constraint, int tower);
 //struct Location trilaterate(struct celltower *towers, uint8_t towerCount, struct Node **hash_table);
 
 #endif
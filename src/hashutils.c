@@ -1,65 +1,116 @@
 #include "hashutils.h"
+#include "rtmem.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 extern size_t DBSIZE;
 
+// Узлы хеш-таблицы берутся из пула, выделенного один раз под всю БД
+static struct mempool node_pool;
+
+// Выделение пула на count узлов
+int init_node_pool(size_t count) {
+    return mempool_init(&node_pool, sizeof(struct Node), count);
+}
+
 // Хеш-функция
 uint64_t hash_function(uint16_t MCC, uint16_t MNC, uint32_t CID) {
     return ((MCC + MNC + CID) % DBSIZE);
 }
 
-// Подсчет строк в БД
-size_t count_db_lines(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+// Верхняя оценка числа строк БД по размеру файла, без чтения файла:
+// пул и таблица выделяются до готовности сервиса, а файл разбирается уже после нее.
+// 0, если файл не открывается или пуст
+size_t db_capacity(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) == -1 || st.st_size == 0) {
         fprintf(stderr, "Cant open file: %s\n", filename);
         return 0;
     }
-    size_t count = 0;
-    char line[256];
-    fgets(line, sizeof(line), file);
-    while (fgets(line, sizeof(line), file)) {
-        count++;
-    }
-    fclose(file);
-    return count;
+    return st.st_size / DB_MIN_LINE_BYTES + 1;
 }
 
-// Парсинг файла БД и вставка в хеш-таблицу
-void parse_and_insert_db(const char *filename, struct Node **hash_table) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+// Разбор одной строки БД и вставка в хеш-таблицу
+static int insert_db_line(const char *line, struct Node **hash_table) {
+    uint16_t MCC, MNC, LAC;
+    uint32_t CID;
+    float LAT, LON;
+    printf("Parsing line: %s", line);
+    sscanf(line, "%*[^,],%hu,%hu,%hu,%u,%*d,%f,%f,%*d,%*d,%*d,%*d,%*d,%*d",
+           &MCC, &MNC, &LAC, &CID, &LON, &LAT);
+    return insert_into_hash_table(hash_table, MCC, MNC, CID, LAT, LON);
+}
+
+// Парсинг файла БД и вставка в хеш-таблицу. Файл читается через read() в статический буфер:
+// разбор идет после готовности сервиса и не выделяет память (fopen выделил бы FILE и его буфер).
+// Строки длиннее DB_MAX_LINE обрезаются. Возвращает число строк или -1, если файл не прочитан
+// или вышки не поместились в пул
+long parse_and_insert_db(const char *filename, struct Node **hash_table) {
+    static char buffer[DB_READ_BUFFER_SIZE];
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
         fprintf(stderr, "Cant open file: %s\n", filename);
-        return;
+        return -1;
     }
 
-    char line[256];
-    // Пропускаем первую строку с заголовком
-    //fgets(line, sizeof(line), file);
-
-    while (fgets(line, sizeof(line), file)) {
-        uint16_t MCC, MNC, LAC;
-        uint32_t CID;
-        float LAT, LON;
-		printf("Parsing line: %s", line );
-        sscanf(line, "%*[^,],%hu,%hu,%hu,%u,%*d,%f,%f,%*d,%*d,%*d,%*d,%*d,%*d", 
-               &MCC, &MNC, &LAC, &CID, &LON, &LAT);
+    // Первая строка с заголовком тоже попадает в таблицу, как и раньше
+    char line[DB_MAX_LINE];
+    size_t line_length = 0;
+    long lines = 0;
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("Ошибка чтения БД");
+            close(fd);
+            return -1;
+        }
+        if (n == 0) break;
 
-        insert_into_hash_table(hash_table, MCC, MNC, CID, LAT, LON);
+        const char *p = buffer, *end = buffer + n;
+        while (p < end) {
+            const char *newline = memchr(p, '\n', end - p);
+            size_t chunk = (newline ? newline + 1 : end) - p;
+            size_t copy = chunk < sizeof(line) - 1 - line_length ? chunk : sizeof(line) - 1 - line_length;
+            memcpy(line + line_length, p, copy);
+            line_length += copy;
+            p += chunk;
+            if (newline) {
+                line[line_length] = '\0';
+                if (insert_db_line(line, hash_table) != 0) {
+                    close(fd);
+                    return -1;
+                }
+                lines++;
+                line_length = 0;
+            }
+        }
     }
-
-    fclose(file);
+    close(fd);
+    // Последняя строка без перевода строки
+    if (line_length > 0) {
+        line[line_length] = '\0';
+        if (insert_db_line(line, hash_table) != 0) {
+            return -1;
+        }
+        lines++;
+    }
+    return lines;
 }
 
-// Вставка новой вышки в хеш-таблицу
-void insert_into_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC, uint32_t CID, float LAT, float LONG) {
+// Вставка новой вышки в хеш-таблицу. Возвращает -1, если пул узлов исчерпан
+int insert_into_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC, uint32_t CID, float LAT, float LONG) {
     unsigned int index = hash_function(MCC, MNC, CID);
     
-    struct Node *new_Node = (struct Node *) malloc(sizeof(struct Node));
+    struct Node *new_Node = (struct Node *) mempool_alloc(&node_pool);
     if (!new_Node) {
-        fprintf(stderr, "memory allocation error\n");
-        return;
+        fprintf(stderr, "node pool exhausted\n");
+        return -1;
     }
     new_Node->MCC = MCC;
     new_Node->MNC = MNC;
@@ -75,6 +126,7 @@ void insert_into_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC
         new_Node->next = hash_table[index];
         hash_table[index] = new_Node;
     }
+    return 0;
 }
 
 // Поиск вышки в хеш-таблице
@@ -94,12 +146,8 @@ struct Node *search_in_hash_table(struct Node **hash_table, uint16_t MCC, uint16
 // Очистка памяти хеш-таблицы
 void free_hash_table(struct Node **hash_table, size_t size) {
     for (size_t i = 0; i < size; i++) {
-        struct Node *current = hash_table[i];
-        while (current != NULL) {
-            struct Node *temp = current;
-            current = current->next;
-            free(temp);
-        }
+        hash_table[i] = NULL;
     }
+    mempool_destroy(&node_pool);
     free(hash_table);
 }
@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#define DB_MIN_LINE_BYTES 28        // Самая короткая строка CSV: 14 полей по символу, 13 запятых и \n
+#define DB_READ_BUFFER_SIZE 65536   // Файл БД читается блоками через read(), без буферов stdio
+#define DB_MAX_LINE 256
+
 extern size_t DBSIZE;
 
 struct Node {
@@ -15,10 +19,11 @@ struct Node {
     struct Node *next; 
 };
 
+int init_node_pool(size_t count);
 uint64_t hash_function(uint16_t MCC, uint16_t MNC, uint32_t CID);
-size_t count_db_lines(const char *filename);
-void parse_and_insert_db(const char *filename, struct Node **hash_table);
-void insert_into_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC, uint32_t CID, float ALT, float LONG);
+size_t db_capacity(const char *filename);
+long parse_and_insert_db(const char *filename, struct Node **hash_table);
+int insert_into_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC, uint32_t CID, float ALT, float LONG);
 struct Node *search_in_hash_table(struct Node **hash_table, uint16_t MCC, uint16_t MNC, uint32_t CID);
 void free_hash_table(struct Node **hash_table, size_t size);
 #endif 
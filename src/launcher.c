@@ -0,0 +1,368 @@
+// launcher.c - запуск сервисов в порядке зависимостей с уведомлением о готовности,
+// привязкой к ядрам, приоритетами SCHED_FIFO и перезапуском упавших сервисов
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "rtmem.h"
+
+#define MAX_SERVICES 8
+#define MAX_ARGS 16
+#define MAX_DEPS 4
+#define NAME_SIZE 32
+#define LINE_SIZE 512
+#define READY_TIMEOUT_MS 15000       // Сервис должен сообщить о готовности за это время
+#define RESTART_DELAY_MS 500         // Начальная задержка перезапуска
+#define RESTART_DELAY_MAX_MS 8000    // Задержка удваивается до этого предела
+#define STABLE_RUN_MS 10000          // После стольких мс работы задержка сбрасывается
+#define POLL_PERIOD_MS 100
+
+enum service_state {
+    SERVICE_STOPPED,    // Ждет запуска (зависимости не готовы или идет задержка перезапуска)
+    SERVICE_STARTING,   // Запущен, ждем уведомления о готовности
+    SERVICE_READY,
+};
+
+struct service {
+    char name[NAME_SIZE];
+    char path[LINE_SIZE];
+    char deps[MAX_DEPS][NAME_SIZE];
+    int dep_count;
+    char cpu_list[NAME_SIZE];  // Как в конфигурации, для сообщений
+    cpu_set_t cpus;
+    int pinned;           // 0 - без привязки (cpu "-1")
+    int priority;         // 0 - обычный планировщик, иначе SCHED_FIFO
+    int mlock;
+    char args[MAX_ARGS][LINE_SIZE / 4];
+    int arg_count;
+
+    enum service_state state;
+    pid_t pid;
+    int ready_fd;         // Читающий конец канала готовности
+    long started_ms;
+    long restart_at_ms;
+    long restart_delay_ms;
+    unsigned restarts;
+};
+
+static struct service services[MAX_SERVICES];
+static int service_count = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+static long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static struct service *find_service(const char *name) {
+    for (int i = 0; i < service_count; i++) {
+        if (strcmp(services[i].name, name) == 0) return &services[i];
+    }
+    return NULL;
+}
+
+// Список ядер: "2", "1,2,3", "1-3" или "-1" (без привязки)
+static int parse_cpu_list(const char *text, cpu_set_t *set, int *pinned) {
+    CPU_ZERO(set);
+    *pinned = 0;
+    if (strcmp(text, "-1") == 0) {
+        return 0;
+    }
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0 || first >= CPU_SETSIZE) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE) return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    *pinned = 1;
+    return 0;
+}
+
+// Разбор конфигурации. Строка: имя путь зависимости cpu приоритет mlock [аргументы...]
+// зависимости через запятую или "-", cpu - ядро или список ядер ("1,2", "1-3"), "-1" - без привязки
+static int load_config(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Cant open file: %s\n", filename);
+        return -1;
+    }
+
+    char line[LINE_SIZE];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *token = strtok(line, " \t\r\n");
+        if (!token) continue;
+        if (service_count >= MAX_SERVICES) {
+            fprintf(stderr, "%s:%d: too many services\n", filename, line_number);
+            fclose(file);
+            return -1;
+        }
+
+        struct service *svc = &services[service_count];
+        memset(svc, 0, sizeof(*svc));
+        strncpy(svc->name, token, NAME_SIZE - 1);
+
+        char *fields[5];
+        for (int i = 0; i < 5; i++) {
+            fields[i] = strtok(NULL, " \t\r\n");
+            if (!fields[i]) {
+                fprintf(stderr, "%s:%d: expected: name path deps cpu priority mlock [args]\n",
+                        filename, line_number);
+                fclose(file);
+                return -1;
+            }
+        }
+        strncpy(svc->path, fields[0], LINE_SIZE - 1);
+        strncpy(svc->cpu_list, fields[2], NAME_SIZE - 1);
+        if (parse_cpu_list(fields[2], &svc->cpus, &svc->pinned) != 0) {
+            fprintf(stderr, "%s:%d: bad cpu list: %s\n", filename, line_number, fields[2]);
+            fclose(file);
+            return -1;
+        }
+        svc->priority = atoi(fields[3]);
+        svc->mlock = atoi(fields[4]);
+
+        char *arg;
+        while ((arg = strtok(NULL, " \t\r\n")) != NULL && svc->arg_count < MAX_ARGS) {
+            strncpy(svc->args[svc->arg_count++], arg, sizeof(svc->args[0]) - 1);
+        }
+
+        if (strcmp(fields[1], "-") != 0) {
+            char *dep = strtok(fields[1], ",");
+            while (dep && svc->dep_count < MAX_DEPS) {
+                strncpy(svc->deps[svc->dep_count++], dep, NAME_SIZE - 1);
+                dep = strtok(NULL, ",");
+            }
+        }
+
+        svc->pid = -1;
+        svc->ready_fd = -1;
+        svc->state = SERVICE_STOPPED;
+        svc->restart_delay_ms = RESTART_DELAY_MS;
+        service_count++;
+    }
+    fclose(file);
+
+    for (int i = 0; i < service_count; i++) {
+        for (int d = 0; d < services[i].dep_count; d++) {
+            if (!find_service(services[i].deps[d])) {
+                fprintf(stderr, "%s: unknown dependency %s\n", services[i].name, services[i].deps[d]);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int deps_ready(const struct service *svc) {
+    for (int d = 0; d < svc->dep_count; d++) {
+        if (find_service(svc->deps[d])->state != SERVICE_READY) return 0;
+    }
+    return 1;
+}
+
+// Настройка процесса сервиса между fork() и exec(): ядро, приоритет, лимит блокировки памяти.
+// Список ядер передается в окружении, только если процесс действительно на них закреплен
+static void setup_child(const struct service *svc, int ready_write_fd) {
+    unsetenv(RT_CPUS_ENV);
+    if (svc->pinned) {
+        if (sched_setaffinity(0, sizeof(svc->cpus), &svc->cpus) == -1) {
+            fprintf(stderr, "[launcher] %s: sched_setaffinity(cpu %s): %s\n", svc->name, svc->cpu_list, strerror(errno));
+        } else {
+            setenv(RT_CPUS_ENV, svc->cpu_list, 1);
+        }
+    }
+    if (svc->priority > 0) {
+        struct sched_param param = {.sched_priority = svc->priority};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+            fprintf(stderr, "[launcher] %s: SCHED_FIFO %d: %s\n", svc->name, svc->priority, strerror(errno));
+        }
+    }
+    // mlockall в самом сервисе (rt_ready) не переживает exec, поэтому здесь снимаем лимит,
+    // а сервису через окружение сообщаем, блокировать ли память
+    if (svc->mlock) {
+        struct rlimit limit = {RLIM_INFINITY, RLIM_INFINITY};
+        if (setrlimit(RLIMIT_MEMLOCK, &limit) == -1) {
+            // Без CAP_SYS_RESOURCE поднимаем хотя бы мягкий лимит до жесткого
+            getrlimit(RLIMIT_MEMLOCK, &limit);
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_MEMLOCK, &limit);
+            fprintf(stderr, "[launcher] %s: RLIMIT_MEMLOCK unlimited: %s, using %llu bytes\n",
+                    svc->name, strerror(errno), (unsigned long long)limit.rlim_cur);
+        }
+    }
+    setenv(RT_MLOCK_ENV, svc->mlock ? "1" : "0", 1);
+
+    char fd_text[16];
+    snprintf(fd_text, sizeof(fd_text), "%d", ready_write_fd);
+    setenv(RT_READY_FD_ENV, fd_text, 1);
+}
+
+static int start_service(struct service *svc) {
+    int ready_pipe[2];
+    if (pipe(ready_pipe) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(ready_pipe[0]);
+        setup_child(svc, ready_pipe[1]);
+        char *argv[MAX_ARGS + 2];
+        argv[0] = svc->path;
+        for (int i = 0; i < svc->arg_count; i++) argv[i + 1] = svc->args[i];
+        argv[svc->arg_count + 1] = NULL;
+        execv(svc->path, argv);
+        fprintf(stderr, "[launcher] exec %s: %s\n", svc->path, strerror(errno));
+        _exit(127);
+    }
+
+    close(ready_pipe[1]);
+    fcntl(ready_pipe[0], F_SETFD, FD_CLOEXEC);
+    svc->pid = pid;
+    svc->ready_fd = ready_pipe[0];
+    svc->state = SERVICE_STARTING;
+    svc->started_ms = monotonic_ms();
+    printf("[launcher] %s started, pid %d\n", svc->name, pid);
+    return 0;
+}
+
+// Сервис завершился: закрываем канал и планируем перезапуск с нарастающей задержкой
+static void on_service_exit(struct service *svc, int status, long now) {
+    if (WIFEXITED(status)) {
+        printf("[launcher] %s (pid %d) exited with code %d\n", svc->name, svc->pid, WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        printf("[launcher] %s (pid %d) killed by signal %d\n", svc->name, svc->pid, WTERMSIG(status));
+    }
+    if (svc->ready_fd != -1) close(svc->ready_fd);
+    svc->ready_fd = -1;
+    svc->pid = -1;
+    svc->state = SERVICE_STOPPED;
+
+    if (now - svc->started_ms > STABLE_RUN_MS) {
+        svc->restart_delay_ms = RESTART_DELAY_MS;
+    }
+    svc->restart_at_ms = now + svc->restart_delay_ms;
+    printf("[launcher] restarting %s in %ld ms\n", svc->name, svc->restart_delay_ms);
+    svc->restart_delay_ms *= 2;
+    if (svc->restart_delay_ms > RESTART_DELAY_MAX_MS) svc->restart_delay_ms = RESTART_DELAY_MAX_MS;
+    svc->restarts++;
+}
+
+static void stop_all(void) {
+    for (int i = service_count - 1; i >= 0; i--) {
+        if (services[i].pid > 0) {
+            printf("[launcher] stopping %s\n", services[i].name);
+            kill(services[i].pid, SIGTERM);
+            waitpid(services[i].pid, NULL, 0);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *config = argc > 1 ? argv[1] : "launcher.conf";
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (load_config(config) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    while (!stop_requested) {
+        long now = monotonic_ms();
+
+        // Сбор завершившихся сервисов
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < service_count; i++) {
+                if (services[i].pid == pid) on_service_exit(&services[i], status, now);
+            }
+        }
+
+        // Запуск сервисов, у которых готовы все зависимости
+        for (int i = 0; i < service_count; i++) {
+            struct service *svc = &services[i];
+            if (svc->state == SERVICE_STOPPED && now >= svc->restart_at_ms && deps_ready(svc)) {
+                if (start_service(svc) != 0) svc->restart_at_ms = now + svc->restart_delay_ms;
+            }
+        }
+
+        // Ожидание уведомлений о готовности
+        struct pollfd fds[MAX_SERVICES];
+        struct service *owners[MAX_SERVICES];
+        int nfds = 0;
+        for (int i = 0; i < service_count; i++) {
+            struct service *svc = &services[i];
+            if (svc->state != SERVICE_STARTING) continue;
+            if (now - svc->started_ms > READY_TIMEOUT_MS) {
+                printf("[launcher] %s not ready after %d ms, killing\n", svc->name, READY_TIMEOUT_MS);
+                kill(svc->pid, SIGKILL);
+                svc->started_ms = now;   // Повторный SIGKILL не нужен, ждем waitpid
+                continue;
+            }
+            fds[nfds].fd = svc->ready_fd;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = svc;
+        }
+        if (poll(fds, nfds, POLL_PERIOD_MS) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < nfds; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP))) continue;
+            char message[16];
+            ssize_t n = read(fds[i].fd, message, sizeof(message));
+            close(owners[i]->ready_fd);
+            owners[i]->ready_fd = -1;
+            if (n > 0) {
+                owners[i]->state = SERVICE_READY;
+                printf("[launcher] %s ready in %ld ms\n", owners[i]->name, monotonic_ms() - owners[i]->started_ms);
+            }
+            // n == 0: канал закрыт без уведомления, сервис завершается - разберет waitpid
+        }
+    }
+
+    stop_all();
+    return 0;
+}
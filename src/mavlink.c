@@ -0,0 +1,416 @@
+#include "mavlink.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define GPS_EPOCH_UNIX_S 315964800L   // 1980-01-06 00:00:00 UTC
+#define GPS_LEAP_SECONDS 18           // GPS впереди UTC
+#define GPS_WEEK_S 604800L
+#define MAVLINK_DEFAULT_BAUD 57600
+
+static long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// CRC-16/MCRF4XX (X.25), как в MAVLink: по байтам кадра после STX и затем по CRC_EXTRA сообщения
+static uint16_t crc_accumulate(uint8_t data, uint16_t crc) {
+    uint8_t tmp = data ^ (uint8_t)(crc & 0xff);
+    tmp ^= (uint8_t)(tmp << 4);
+    return (crc >> 8) ^ ((uint16_t)tmp << 8) ^ ((uint16_t)tmp << 3) ^ (tmp >> 4);
+}
+
+uint16_t mavlink_crc(const uint8_t *data, size_t length, uint16_t crc) {
+    for (size_t i = 0; i < length; i++) {
+        crc = crc_accumulate(data[i], crc);
+    }
+    return crc;
+}
+
+// Поля пишутся в little-endian независимо от платформы
+static uint8_t *put_u16(uint8_t *p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+    return p + 4;
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = value >> (8 * i);
+    return p + 8;
+}
+
+static uint8_t *put_float(uint8_t *p, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return put_u32(p, bits);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static float get_float(const uint8_t *p) {
+    uint32_t bits = get_u32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Упаковка GPS_INPUT в кадр MAVLink v2, возвращает длину кадра.
+// Нулевые байты в конце полезной нагрузки отбрасываются, как требует v2
+size_t mavlink_pack_gps_input(const struct gps_input *msg, uint8_t seq, uint8_t *frame) {
+    uint8_t *payload = frame + MAVLINK_HEADER_LEN;
+    uint8_t *p = payload;
+    p = put_u64(p, msg->time_usec);
+    p = put_u32(p, msg->time_week_ms);
+    p = put_u32(p, (uint32_t)msg->lat);
+    p = put_u32(p, (uint32_t)msg->lon);
+    p = put_float(p, msg->alt);
+    p = put_float(p, msg->hdop);
+    p = put_float(p, msg->vdop);
+    p = put_float(p, msg->vn);
+    p = put_float(p, msg->ve);
+    p = put_float(p, msg->vd);
+    p = put_float(p, msg->speed_accuracy);
+    p = put_float(p, msg->horiz_accuracy);
+    p = put_float(p, msg->vert_accuracy);
+    p = put_u16(p, msg->ignore_flags);
+    p = put_u16(p, msg->time_week);
+    *p++ = msg->gps_id;
+    *p++ = msg->fix_type;
+    *p++ = msg->satellites_visible;
+
+    uint8_t length = MAVLINK_GPS_INPUT_LEN;
+    while (length > 1 && payload[length - 1] == 0) {
+        length--;
+    }
+
+    frame[0] = MAVLINK_STX;
+    frame[1] = length;
+    frame[2] = 0;  // incompat_flags: без подписи
+    frame[3] = 0;  // compat_flags
+    frame[4] = seq;
+    frame[5] = MAVLINK_SYSTEM_ID;
+    frame[6] = MAVLINK_COMPONENT_ID;
+    frame[7] = MAVLINK_MSG_ID_GPS_INPUT & 0xff;
+    frame[8] = (MAVLINK_MSG_ID_GPS_INPUT >> 8) & 0xff;
+    frame[9] = (MAVLINK_MSG_ID_GPS_INPUT >> 16) & 0xff;
+
+    uint16_t crc = mavlink_crc(frame + 1, MAVLINK_HEADER_LEN - 1 + length, 0xffff);
+    crc = crc_accumulate(MAVLINK_GPS_INPUT_CRC_EXTRA, crc);
+    put_u16(payload + length, crc);
+    return MAVLINK_HEADER_LEN + length + MAVLINK_CRC_LEN;
+}
+
+// Разбор кадра GPS_INPUT с проверкой STX, идентификатора и CRC.
+// Возвращает длину кадра или -1, если кадр неполный или поврежден
+int mavlink_unpack_gps_input(const uint8_t *frame, size_t length, struct gps_input *msg, uint8_t *seq) {
+    if (length < MAVLINK_HEADER_LEN + MAVLINK_CRC_LEN || frame[0] != MAVLINK_STX) {
+        return -1;
+    }
+    uint8_t payload_length = frame[1];
+    size_t frame_length = MAVLINK_HEADER_LEN + payload_length + MAVLINK_CRC_LEN;
+    uint32_t msgid = frame[7] | (uint32_t)frame[8] << 8 | (uint32_t)frame[9] << 16;
+    if (length < frame_length || msgid != MAVLINK_MSG_ID_GPS_INPUT || payload_length > MAVLINK_GPS_INPUT_LEN) {
+        return -1;
+    }
+    uint16_t crc = mavlink_crc(frame + 1, MAVLINK_HEADER_LEN - 1 + payload_length, 0xffff);
+    crc = crc_accumulate(MAVLINK_GPS_INPUT_CRC_EXTRA, crc);
+    if (crc != get_u16(frame + MAVLINK_HEADER_LEN + payload_length)) {
+        return -1;
+    }
+
+    // Отброшенные нули в конце восстанавливаются
+    uint8_t payload[MAVLINK_GPS_INPUT_LEN] = {0};
+    memcpy(payload, frame + MAVLINK_HEADER_LEN, payload_length);
+    const uint8_t *p = payload;
+    msg->time_usec = get_u64(p);
+    msg->time_week_ms = get_u32(p + 8);
+    msg->lat = (int32_t)get_u32(p + 12);
+    msg->lon = (int32_t)get_u32(p + 16);
+    msg->alt = get_float(p + 20);
+    msg->hdop = get_float(p + 24);
+    msg->vdop = get_float(p + 28);
+    msg->vn = get_float(p + 32);
+    msg->ve = get_float(p + 36);
+    msg->vd = get_float(p + 40);
+    msg->speed_accuracy = get_float(p + 44);
+    msg->horiz_accuracy = get_float(p + 48);
+    msg->vert_accuracy = get_float(p + 52);
+    msg->ignore_flags = get_u16(p + 56);
+    msg->time_week = get_u16(p + 58);
+    msg->gps_id = p[60];
+    msg->fix_type = p[61];
+    msg->satellites_visible = p[62];
+    if (seq) *seq = frame[4];
+    return frame_length;
+}
+
+// Время utc (CLOCK_REALTIME) в шкале GPS (неделя и мс недели) и UNIX-время в мкс
+void mavlink_gps_time(const struct timespec *utc, uint16_t *week, uint32_t *week_ms, uint64_t *time_usec) {
+    long gps_s = utc->tv_sec - GPS_EPOCH_UNIX_S + GPS_LEAP_SECONDS;
+    *week = gps_s / GPS_WEEK_S;
+    *week_ms = (gps_s % GPS_WEEK_S) * 1000 + utc->tv_nsec / 1000000;
+    *time_usec = (uint64_t)utc->tv_sec * 1000000 + utc->tv_nsec / 1000;
+}
+
+// Заполнение GPS_INPUT по решению: только горизонтальное положение и его точность
+// (DRMS по ковариации решателя, увеличенный на сдвиг MAVLINK_DRIFT_SPEED_MPS за возраст решения age_s).
+// Время - момент решения, а не отправки: повтор кадра не выдается за новое измерение.
+// Высота и скорость автопилотом игнорируются
+static void fill_gps_input(struct gps_input *msg, const struct mavlink_fix *fix, uint8_t fix_type, double age_s) {
+    memset(msg, 0, sizeof(*msg));
+    mavlink_gps_time(&fix->utc, &msg->time_week, &msg->time_week_ms, &msg->time_usec);
+    msg->lat = (int32_t)lround(fix->fix.location.latitude * 1e7);
+    msg->lon = (int32_t)lround(fix->fix.location.longitude * 1e7);
+    msg->ignore_flags = GPS_INPUT_IGNORE_FLAG_ALT | GPS_INPUT_IGNORE_FLAG_HDOP | GPS_INPUT_IGNORE_FLAG_VDOP |
+                        GPS_INPUT_IGNORE_FLAG_VEL_HORIZ | GPS_INPUT_IGNORE_FLAG_VEL_VERT |
+                        GPS_INPUT_IGNORE_FLAG_SPEED_ACCURACY | GPS_INPUT_IGNORE_FLAG_VERTICAL_ACCURACY;
+    double variance = fix->fix.cov_nn + fix->fix.cov_ee;
+    if (isfinite(variance) && variance > 0.0) {
+        double drift_m = MAVLINK_DRIFT_SPEED_MPS * age_s;
+        msg->horiz_accuracy = sqrt(variance + drift_m * drift_m);
+    } else {
+        msg->ignore_flags |= GPS_INPUT_IGNORE_FLAG_HORIZONTAL_ACCURACY;
+    }
+    msg->gps_id = MAVLINK_GPS_ID;
+    msg->fix_type = fix_type;
+    msg->satellites_visible = fix->towers;  // Число вышек в решении
+}
+
+static void send_frame(struct mavlink_output *out, const uint8_t *frame, size_t length) {
+    ssize_t written = out->is_udp ? send(out->fd, frame, length, MSG_NOSIGNAL) : write(out->fd, frame, length);
+    if (written != (ssize_t)length) {
+        out->send_errors++;
+    }
+}
+
+// Поток отправки: тик каждые MAVLINK_PERIOD_MS по абсолютному времени (без накопления дрейфа).
+// На тике отправляется самое новое решение из очереди; если очередь пуста - повтор последнего
+// решения с растущей погрешностью, пока оно не старше MAVLINK_STALE_MS, иначе NO_FIX
+static void *sender_main(void *arg) {
+    struct mavlink_output *out = arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (out->running) {
+        next.tv_nsec += MAVLINK_PERIOD_MS * 1000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long late_us = (now.tv_sec - next.tv_sec) * 1000000L + (now.tv_nsec - next.tv_nsec) / 1000;
+        if (late_us > out->late_us_max) out->late_us_max = late_us;
+        // Пропущен целый период (поток был вытеснен) - сетка сдвигается, без пачки догоняющих кадров
+        if (late_us > MAVLINK_PERIOD_MS * 1000L) next = now;
+
+        struct mavlink_fix fix;
+        int fresh = 0;
+        pthread_mutex_lock(&out->lock);
+        if (out->length > 0) {
+            // Отправляется самое новое решение, более старые из очереди отбрасываются
+            fix = out->queue[(out->head + out->length - 1) % MAVLINK_QUEUE_SIZE];
+            out->dropped += out->length - 1;
+            out->head = 0;
+            out->length = 0;
+            fresh = 1;
+        }
+        pthread_mutex_unlock(&out->lock);
+
+        uint8_t fix_type = GPS_FIX_TYPE_2D_FIX;
+        if (fresh) {
+            out->last = fix;
+            out->have_last = 1;
+        } else if (out->have_last && monotonic_ms() - out->last.time_ms < MAVLINK_STALE_MS) {
+            fix = out->last;
+            out->repeated++;
+        } else {
+            fix = out->last;  // Нули, если решений еще не было
+            clock_gettime(CLOCK_REALTIME, &fix.utc);  // NO_FIX относится к моменту отправки
+            fix_type = GPS_FIX_TYPE_NO_FIX;
+            out->no_fix++;
+        }
+
+        struct gps_input msg;
+        uint8_t frame[MAVLINK_MAX_FRAME];
+        double age_s = fix_type == GPS_FIX_TYPE_2D_FIX ? (monotonic_ms() - fix.time_ms) / 1000.0 : 0.0;
+        fill_gps_input(&msg, &fix, fix_type, age_s);
+        send_frame(out, frame, mavlink_pack_gps_input(&msg, out->seq++, frame));
+        out->sent++;
+
+        if (out->sent % MAVLINK_STATS_PERIOD == 0) {
+            printf("[MAVLINK] sent=%lu repeated=%lu no_fix=%lu dropped=%lu inaccurate=%lu errors=%lu late_max=%ldus\n",
+                   out->sent, out->repeated, out->no_fix, out->dropped, out->inaccurate, out->send_errors,
+                   out->late_us_max);
+            out->late_us_max = 0;
+        }
+    }
+    return NULL;
+}
+
+static speed_t baud_to_speed(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+// Последовательный порт в сыром режиме 8N1
+static int open_serial(const char *path, int baud) {
+    speed_t speed = baud_to_speed(baud);
+    if (speed == B0) {
+        fprintf(stderr, "Неподдерживаемая скорость MAVLink: %d\n", baud);
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd == -1) {
+        perror("Ошибка открытия порта MAVLink");
+        return -1;
+    }
+    struct termios options;
+    tcgetattr(fd, &options);
+    cfmakeraw(&options);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    options.c_cflag |= (CLOCAL | CREAD);
+    options.c_cflag &= ~(PARENB | CSTOPB | CRTSCTS);
+    tcsetattr(fd, TCSANOW, &options);
+    return fd;
+}
+
+static int open_udp(const char *host, int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Некорректный адрес MAVLink: %s\n", host);
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        perror("Ошибка создания сокета MAVLink");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("Ошибка подключения сокета MAVLink");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// target: "udp:ADDR:PORT" или "/dev/ttyX[:BAUD]". Поток отправки создается здесь, до готовности сервиса.
+// max_hacc_m - потолок точности: решение хуже не отправляется, автопилот получает повтор
+// предыдущего решения, а через MAVLINK_STALE_MS - NO_FIX
+int mavlink_open(struct mavlink_output *out, const char *target, double max_hacc_m) {
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    out->max_hacc_m = max_hacc_m;
+
+    char spec[128];
+    strncpy(spec, target, sizeof(spec) - 1);
+    spec[sizeof(spec) - 1] = '\0';
+    char *colon = strrchr(spec, ':');
+    if (strncmp(spec, "udp:", 4) == 0) {
+        if (colon == spec + 3) {
+            fprintf(stderr, "Ожидается udp:ADDR:PORT: %s\n", target);
+            return -1;
+        }
+        *colon = '\0';
+        out->fd = open_udp(spec + 4, atoi(colon + 1));
+        out->is_udp = 1;
+    } else {
+        int baud = MAVLINK_DEFAULT_BAUD;
+        if (colon) {
+            *colon = '\0';
+            baud = atoi(colon + 1);
+        }
+        out->fd = open_serial(spec, baud);
+    }
+    if (out->fd == -1) {
+        return -1;
+    }
+
+    pthread_mutex_init(&out->lock, NULL);
+    out->running = 1;
+    if (pthread_create(&out->thread, NULL, sender_main, out) != 0) {
+        perror("Ошибка создания потока MAVLink");
+        close(out->fd);
+        out->fd = -1;
+        return -1;
+    }
+    printf("[MAVLINK] GPS_INPUT -> %s every %dms\n", target, MAVLINK_PERIOD_MS);
+    return 0;
+}
+
+// Постановка решения в очередь; при переполнении отбрасывается самое старое.
+// Решение с точностью хуже max_hacc_m не ставится; неизвестная точность (NAN) пропускается
+void mavlink_publish(struct mavlink_output *out, const struct position_fix *fix, uint8_t towers) {
+    if (out->fd == -1) {
+        return;
+    }
+    double variance = fix->cov_nn + fix->cov_ee;
+    pthread_mutex_lock(&out->lock);
+    if (isfinite(variance) && variance > out->max_hacc_m * out->max_hacc_m) {
+        out->inaccurate++;
+        pthread_mutex_unlock(&out->lock);
+        return;
+    }
+    if (out->length == MAVLINK_QUEUE_SIZE) {
+        out->head = (out->head + 1) % MAVLINK_QUEUE_SIZE;
+        out->length--;
+        out->dropped++;
+    }
+    struct mavlink_fix *slot = &out->queue[(out->head + out->length) % MAVLINK_QUEUE_SIZE];
+    slot->fix = *fix;
+    slot->towers = towers;
+    slot->time_ms = monotonic_ms();
+    clock_gettime(CLOCK_REALTIME, &slot->utc);
+    out->length++;
+    pthread_mutex_unlock(&out->lock);
+}
+
+void mavlink_close(struct mavlink_output *out) {
+    if (out->fd == -1) {
+        return;
+    }
+    out->running = 0;
+    pthread_join(out->thread, NULL);
+    pthread_mutex_destroy(&out->lock);
+    close(out->fd);
+    out->fd = -1;
+}
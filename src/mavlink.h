@@ -0,0 +1,103 @@
+#ifndef MAVLINK_H
+#define MAVLINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "geoprocessing.h"
+
+// Кадр MAVLink v2: STX, len, incompat, compat, seq, sysid, compid, msgid[3], payload, crc[2]
+#define MAVLINK_STX 0xFD
+#define MAVLINK_HEADER_LEN 10
+#define MAVLINK_CRC_LEN 2
+#define MAVLINK_MAX_PAYLOAD 255
+#define MAVLINK_MAX_FRAME (MAVLINK_HEADER_LEN + MAVLINK_MAX_PAYLOAD + MAVLINK_CRC_LEN)
+
+#define MAVLINK_MSG_ID_GPS_INPUT 232
+#define MAVLINK_GPS_INPUT_LEN 63
+#define MAVLINK_GPS_INPUT_CRC_EXTRA 151
+
+#define MAVLINK_SYSTEM_ID 1           // Система автопилота: сообщение приходит как от его компаньона
+#define MAVLINK_COMPONENT_ID 191      // MAV_COMP_ID_ONBOARD_COMPUTER
+#define MAVLINK_GPS_ID 1              // Номер GPS у автопилота (GPS_TYPE = MAV, второй приемник)
+
+#define MAVLINK_PERIOD_MS 200         // Отправка с постоянным темпом 5 Гц
+#define MAVLINK_QUEUE_SIZE 4          // Решений в очереди; при переполнении отбрасывается старое
+#define MAVLINK_STALE_MS 1000         // После этого без новых решений отправляется NO_FIX
+#define MAVLINK_MAX_HACC_M 5000.0     // Решения с худшей точностью (DRMS) не отправляются
+#define MAVLINK_DRIFT_SPEED_MPS 15.0  // С этой скоростью растет погрешность решения с его возрастом
+#define MAVLINK_STATS_PERIOD 50       // Отправок между строками [MAVLINK]
+
+// GPS_FIX_TYPE
+#define GPS_FIX_TYPE_NO_FIX 1
+#define GPS_FIX_TYPE_2D_FIX 2
+
+// GPS_INPUT_IGNORE_FLAGS
+#define GPS_INPUT_IGNORE_FLAG_ALT 1
+#define GPS_INPUT_IGNORE_FLAG_HDOP 2
+#define GPS_INPUT_IGNORE_FLAG_VDOP 4
+#define GPS_INPUT_IGNORE_FLAG_VEL_HORIZ 8
+#define GPS_INPUT_IGNORE_FLAG_VEL_VERT 16
+#define GPS_INPUT_IGNORE_FLAG_SPEED_ACCURACY 32
+#define GPS_INPUT_IGNORE_FLAG_HORIZONTAL_ACCURACY 64
+#define GPS_INPUT_IGNORE_FLAG_VERTICAL_ACCURACY 128
+
+// Поля GPS_INPUT в порядке передачи (по убыванию размера типа)
+struct gps_input {
+    uint64_t time_usec;
+    uint32_t time_week_ms;
+    int32_t lat;               // градусы * 1e7
+    int32_t lon;
+    float alt;
+    float hdop;
+    float vdop;
+    float vn;
+    float ve;
+    float vd;
+    float speed_accuracy;
+    float horiz_accuracy;      // м
+    float vert_accuracy;
+    uint16_t ignore_flags;
+    uint16_t time_week;
+    uint8_t gps_id;
+    uint8_t fix_type;
+    uint8_t satellites_visible;
+};
+
+// Решение, поставленное в очередь отправки
+struct mavlink_fix {
+    struct position_fix fix;
+    uint8_t towers;
+    long time_ms;              // CLOCK_MONOTONIC момента решения
+    struct timespec utc;       // CLOCK_REALTIME момента решения, передается как время измерения
+};
+
+// Выход MAVLink: UDP или последовательный порт, поток отправки 5 Гц и ограниченная очередь
+struct mavlink_output {
+    int fd;
+    int is_udp;
+    pthread_t thread;
+    volatile int running;
+    pthread_mutex_t lock;
+    struct mavlink_fix queue[MAVLINK_QUEUE_SIZE];
+    uint8_t head, length;
+    struct mavlink_fix last;   // Последнее отправленное решение, повторяется до MAVLINK_STALE_MS
+    int have_last;
+    uint8_t seq;
+    double max_hacc_m;         // Потолок точности решения для постановки в очередь, м
+    // Статистика
+    unsigned long sent, dropped, repeated, no_fix, send_errors;
+    unsigned long inaccurate;  // Решения, отброшенные по max_hacc_m
+    long late_us_max;          // Наибольшее опоздание отправки относительно сетки 200 мс
+};
+
+uint16_t mavlink_crc(const uint8_t *data, size_t length, uint16_t crc);
+size_t mavlink_pack_gps_input(const struct gps_input *msg, uint8_t seq, uint8_t *frame);
+int mavlink_unpack_gps_input(const uint8_t *frame, size_t length, struct gps_input *msg, uint8_t *seq);
+void mavlink_gps_time(const struct timespec *utc, uint16_t *week, uint32_t *week_ms, uint64_t *time_usec);
+
+int mavlink_open(struct mavlink_output *out, const char *target, double max_hacc_m);
+void mavlink_publish(struct mavlink_output *out, const struct position_fix *fix, uint8_t towers);
+void mavlink_close(struct mavlink_output *out);
+
+#endif
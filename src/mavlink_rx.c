@@ -0,0 +1,129 @@
+// mavlink_rx.c - проверочный приемник GPS_INPUT от cordcalculation --mavlink udp:127.0.0.1:PORT
+//   mavlink_rx PORT [COUNT] - принимает COUNT кадров (по умолчанию 50) или до паузы RX_IDLE_TIMEOUT_S
+// Проверяет CRC, непрерывность seq, содержимое (координаты, тип решения, точность) и темп:
+// интервалы между кадрами должны укладываться в MAVLINK_PERIOD_MS +- RX_TOLERANCE_MS.
+// Код возврата 0, если все кадры прошли проверку
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "mavlink.h"
+
+#define RX_DEFAULT_COUNT 50
+#define RX_TOLERANCE_MS 20.0          // Допуск интервала между кадрами
+#define RX_IDLE_TIMEOUT_S 5
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Проверка содержимого: число ошибок в кадре
+static int check_content(const struct gps_input *msg) {
+    int errors = 0;
+    if (msg->fix_type != GPS_FIX_TYPE_2D_FIX && msg->fix_type != GPS_FIX_TYPE_NO_FIX) {
+        printf("  bad fix_type %d\n", msg->fix_type);
+        errors++;
+    }
+    if (msg->fix_type == GPS_FIX_TYPE_2D_FIX &&
+        (abs(msg->lat) > 900000000 || abs(msg->lon) > 1800000000 || (msg->lat == 0 && msg->lon == 0))) {
+        printf("  bad position %d %d\n", msg->lat, msg->lon);
+        errors++;
+    }
+    if (!(msg->ignore_flags & GPS_INPUT_IGNORE_FLAG_HORIZONTAL_ACCURACY) &&
+        !(isfinite(msg->horiz_accuracy) && msg->horiz_accuracy > 0.0f)) {
+        printf("  bad horiz_accuracy %f\n", msg->horiz_accuracy);
+        errors++;
+    }
+    if (msg->gps_id != MAVLINK_GPS_ID || msg->time_week == 0) {
+        printf("  bad gps_id %d or time_week %d\n", msg->gps_id, msg->time_week);
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s PORT [COUNT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int port = atoi(argv[1]);
+    long count = argc == 3 ? atol(argv[2]) : RX_DEFAULT_COUNT;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("Ошибка открытия сокета");
+        return EXIT_FAILURE;
+    }
+    struct timeval timeout = {RX_IDLE_TIMEOUT_S, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    long received = 0, bad_frames = 0, content_errors = 0, seq_gaps = 0, off_period = 0;
+    long fixes = 0, no_fix = 0;
+    double last_ms = 0.0, sum_dt = 0.0, sum_dt2 = 0.0, min_dt = INFINITY, max_dt = 0.0;
+    int last_seq = -1;
+    while (received < count) {
+        uint8_t frame[MAVLINK_MAX_FRAME];
+        ssize_t length = recv(fd, frame, sizeof(frame), 0);
+        if (length <= 0) {
+            printf("No data for %ds\n", RX_IDLE_TIMEOUT_S);
+            break;
+        }
+        double now_ms = monotonic_ms();
+
+        struct gps_input msg;
+        uint8_t seq;
+        if (mavlink_unpack_gps_input(frame, length, &msg, &seq) < 0) {
+            printf("bad frame (%zd bytes)\n", length);
+            bad_frames++;
+            continue;
+        }
+        received++;
+        if (last_seq >= 0 && seq != (uint8_t)(last_seq + 1)) {
+            seq_gaps++;
+        }
+        last_seq = seq;
+
+        double dt = 0.0;
+        if (last_ms > 0.0) {
+            dt = now_ms - last_ms;
+            sum_dt += dt;
+            sum_dt2 += dt * dt;
+            if (dt < min_dt) min_dt = dt;
+            if (dt > max_dt) max_dt = dt;
+            if (fabs(dt - MAVLINK_PERIOD_MS) > RX_TOLERANCE_MS) off_period++;
+        }
+        last_ms = now_ms;
+
+        if (msg.fix_type == GPS_FIX_TYPE_2D_FIX) fixes++;
+        else no_fix++;
+        printf("seq=%3d dt=%6.1fms fix=%d LAT=%.6f LONG=%.6f hacc=%.0fm towers=%d week=%d ms=%u\n",
+               seq, dt, msg.fix_type, msg.lat / 1e7, msg.lon / 1e7,
+               (msg.ignore_flags & GPS_INPUT_IGNORE_FLAG_HORIZONTAL_ACCURACY) ? -1.0 : msg.horiz_accuracy,
+               msg.satellites_visible, msg.time_week, msg.time_week_ms);
+        content_errors += check_content(&msg);
+    }
+    close(fd);
+
+    long intervals = received > 1 ? received - 1 : 0;
+    double mean = intervals ? sum_dt / intervals : 0.0;
+    double jitter = intervals ? sqrt(sum_dt2 / intervals - mean * mean) : 0.0;
+    printf("[MAVLINK RX] frames=%ld (fix=%ld, no_fix=%ld), bad=%ld, seq_gaps=%ld, content_errors=%ld\n",
+           received, fixes, no_fix, bad_frames, seq_gaps, content_errors);
+    printf("[MAVLINK RX] interval mean=%.2fms jitter=%.2fms min=%.2fms max=%.2fms, outside +-%.0fms: %ld\n",
+           mean, jitter, intervals ? min_dt : 0.0, max_dt, RX_TOLERANCE_MS, off_period);
+
+    int ok = received == count && bad_frames == 0 && seq_gaps == 0 && content_errors == 0 && off_period == 0;
+    printf("[MAVLINK RX] %s\n", ok ? "PASS" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,5 +20,41 @@ typedef struct {
     float LONG;
 } search_response_t;
 
+// Типы сообщений между сервисами
+#define MSG_TYPE_TOWER 1          // Данные одной вышки
+#define MSG_TYPE_SNAPSHOT_END 2   // Конец снимка: все вышки одного ответа AT+CENG? переданы
+#define MSG_TYPE_FEEDBACK 3       // Обратная связь cordcalculation -> sim_handler
+
+#define CONTROL_SOCKET_PATH "/tmp/control_socket"
+
+// sim_handler -> dbsearch (/tmp/gsm_socket)
+typedef struct {
+    long msg_type;
+    uint16_t MCC;
+    uint16_t MNC;
+    uint32_t CID;
+    int receive_level;
+    uint8_t TA;          // Timing Advance, TA_UNKNOWN (0xFF) - нет данных
+} level_data_t;
+
+// dbsearch -> cordcalculation (/tmp/display_socket)
+typedef struct {
+    long msg_type;
+    uint16_t MCC;
+    uint16_t MNC;
+    uint32_t CID;
+    int receive_level;
+    uint8_t TA;          // Timing Advance, TA_UNKNOWN (0xFF) - нет данных
+    float LAT;
+    float LONG;
+} tower_info_t;
+
+// cordcalculation -> sim_handler (CONTROL_SOCKET_PATH, датаграммы): после каждого снимка
+typedef struct {
+    long msg_type;
+    float speed_mps;     // Оценка скорости, м/с
+    float hacc_m;        // DRMS решения, м; INFINITY - решения нет, NAN - точность не известна
+} feedback_t;
+
 #endif // MSG_DEFINITIONS_H
 
@@ -0,0 +1,450 @@
+#define _GNU_SOURCE
+#include "particle.h"
+#include "rtmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+#define PF_SUM_BLOCK 256          // Векторов на блок частичных сумм в float, затем перенос в double
+
+enum pf_phase {
+    PF_PHASE_INIT,                // Начальное облако частиц
+    PF_PHASE_PREDICT,             // Модель движения и логарифм правдоподобия
+    PF_PHASE_WEIGHT,              // Пересчет весов и суммы для оценки
+    PF_PHASE_RESAMPLE,            // Перевыборка с малой дисперсией в буферы n*
+    PF_PHASE_EXIT,
+};
+
+static long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static inline f32x4 v_splat(float value) {
+    return (f32x4){value, value, value, value};
+}
+
+static inline f32x4 v_select(i32x4 mask, f32x4 a, f32x4 b) {
+    return (f32x4)(((i32x4)a & mask) | ((i32x4)b & ~mask));
+}
+
+static inline f32x4 v_max(f32x4 a, f32x4 b) {
+    return v_select(a > b, a, b);
+}
+
+// log2(x) для x > 0: показатель из битов float и квадратичное приближение мантиссы, ошибка < 0.005
+static inline f32x4 v_log2(f32x4 x) {
+    i32x4 bits = (i32x4)x;
+    f32x4 e = __builtin_convertvector(((bits >> 23) & 0xff) - 127, f32x4);
+    f32x4 m = (f32x4)((bits & 0x7fffff) | 0x3f800000);
+    return e + (m * -0.34484843f + 2.02466578f) * m - 0.67487759f;
+}
+
+// 2^x для x <= 0: целая часть в показатель, дробная - кубический полином, ошибка ~1e-4
+static inline f32x4 v_exp2(f32x4 x) {
+    x = v_max(x, v_splat(-126.0f));
+    i32x4 i = __builtin_convertvector(x, i32x4);
+    i += (i32x4)(__builtin_convertvector(i, f32x4) > x);  // Округление вниз для отрицательных
+    f32x4 f = x - __builtin_convertvector(i, f32x4);
+    f32x4 p = ((f * 0.07806707f + 0.22606716f) * f + 0.69583354f) * f + 1.0f;
+    return (f32x4)((i + 127) << 23) * p;
+}
+
+// Равномерное [0, 1) по дорожкам: xorshift32
+static inline f32x4 v_uniform(u32x4 *state) {
+    u32x4 s = *state;
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    *state = s;
+    return (f32x4)((s >> 9) | 0x3f800000) - 1.0f;
+}
+
+// Приближенно нормальное N(0, 1): сумма четырех равномерных
+static inline f32x4 v_gauss(u32x4 *state) {
+    f32x4 sum = v_uniform(state) + v_uniform(state) + v_uniform(state) + v_uniform(state);
+    return (sum - 2.0f) * 1.7320508f;
+}
+
+static void phase_init(struct particle_filter *pf, struct pf_worker *w, u32x4 *rng) {
+    f32x4 *X = (f32x4 *)pf->x, *Y = (f32x4 *)pf->y, *VX = (f32x4 *)pf->vx, *VY = (f32x4 *)pf->vy;
+    f32x4 *W = (f32x4 *)pf->w;
+    for (uint32_t i = w->first / PF_LANES; i < w->last / PF_LANES; i++) {
+        X[i] = (v_uniform(rng) * 2.0f - 1.0f) * pf->init_spread_m;
+        Y[i] = (v_uniform(rng) * 2.0f - 1.0f) * pf->init_spread_m;
+        VX[i] = v_gauss(rng) * (float)PF_INIT_SPEED_MPS;
+        VY[i] = v_gauss(rng) * (float)PF_INIT_SPEED_MPS;
+        W[i] = v_splat(1.0f);
+    }
+}
+
+// Модель постоянной скорости со случайным ускорением, затем правдоподобие по всем вышкам снимка:
+// дальность по уровню сигнала (логнормальная ошибка) и кольцо TA
+static void phase_predict(struct particle_filter *pf, struct pf_worker *w, u32x4 *rng) {
+    f32x4 *X = (f32x4 *)pf->x, *Y = (f32x4 *)pf->y, *VX = (f32x4 *)pf->vx, *VY = (f32x4 *)pf->vy;
+    f32x4 *LL = (f32x4 *)pf->ll;
+    const float dt = pf->dt;
+    const float accel = (float)PF_ACCEL_SIGMA * dt;
+    // Коэффициенты в единицах log2: вес частицы = 2^ll
+    const float sigma_log2 = (float)(PF_RXLEV_SIGMA_DB / 20.0 * log2(10.0));
+    const float k_range = 1.0f / (2.0f * sigma_log2 * sigma_log2 * (float)M_LN2);
+    const float k_ta = 1.0f / (2.0f * (float)(PF_TA_SIGMA_M * PF_TA_SIGMA_M) * (float)M_LN2);
+
+    f32x4 ll_max = v_splat(-INFINITY);
+    for (uint32_t i = w->first / PF_LANES; i < w->last / PF_LANES; i++) {
+        f32x4 vx = VX[i] + v_gauss(rng) * accel;
+        f32x4 vy = VY[i] + v_gauss(rng) * accel;
+        f32x4 x = X[i] + vx * dt;
+        f32x4 y = Y[i] + vy * dt;
+        VX[i] = vx;
+        VY[i] = vy;
+        X[i] = x;
+        Y[i] = y;
+
+        f32x4 ll = v_splat(0.0f);
+        for (uint8_t k = 0; k < pf->obs_count; k++) {
+            const struct pf_observation *o = &pf->obs[k];
+            f32x4 dx = x - o->x, dy = y - o->y;
+            f32x4 log2_d = v_log2(dx * dx + dy * dy + 1.0f) * 0.5f;
+            f32x4 res = log2_d - o->log2_range;
+            ll -= res * res * k_range;
+            if (o->ta_max >= 0.0f) {
+                f32x4 d = v_exp2(log2_d);
+                f32x4 out = v_max(v_max(o->ta_min - d, d - o->ta_max), v_splat(0.0f));
+                ll -= out * out * k_ta;
+            }
+        }
+        LL[i] = ll;
+        ll_max = v_max(ll_max, ll);
+    }
+    w->ll_max = -INFINITY;
+    for (int lane = 0; lane < PF_LANES; lane++) {
+        if (ll_max[lane] > w->ll_max) w->ll_max = ll_max[lane];
+    }
+}
+
+// Веса умножаются на 2^(ll - max) и нормируются к среднему 1 (масштаб прошлого обновления).
+// Суммы для среднего и ковариации считаются относительно прошлой оценки
+static void phase_weight(struct particle_filter *pf, struct pf_worker *w) {
+    f32x4 *X = (f32x4 *)pf->x, *Y = (f32x4 *)pf->y, *VX = (f32x4 *)pf->vx, *VY = (f32x4 *)pf->vy;
+    f32x4 *W = (f32x4 *)pf->w, *LL = (f32x4 *)pf->ll;
+    const float scale = pf->w_total > 0.0 ? (float)(pf->count / pf->w_total) : 1.0f;
+    const float mx = (float)pf->mean_x, my = (float)pf->mean_y;
+
+    w->sum_w = w->sum_w2 = w->sum_x = w->sum_y = 0.0;
+    w->sum_xx = w->sum_xy = w->sum_yy = w->sum_vx = w->sum_vy = 0.0;
+    uint32_t first = w->first / PF_LANES, last = w->last / PF_LANES;
+    for (uint32_t base = first; base < last; base += PF_SUM_BLOCK) {
+        uint32_t end = base + PF_SUM_BLOCK < last ? base + PF_SUM_BLOCK : last;
+        f32x4 s_w = {0}, s_w2 = {0}, s_x = {0}, s_y = {0}, s_xx = {0}, s_xy = {0}, s_yy = {0};
+        f32x4 s_vx = {0}, s_vy = {0};
+        for (uint32_t i = base; i < end; i++) {
+            f32x4 wt = W[i] * v_exp2(LL[i] - pf->ll_max) * scale;
+            W[i] = wt;
+            f32x4 dx = X[i] - mx, dy = Y[i] - my;
+            s_w += wt;
+            s_w2 += wt * wt;
+            s_x += wt * dx;
+            s_y += wt * dy;
+            s_xx += wt * dx * dx;
+            s_xy += wt * dx * dy;
+            s_yy += wt * dy * dy;
+            s_vx += wt * VX[i];
+            s_vy += wt * VY[i];
+        }
+        for (int lane = 0; lane < PF_LANES; lane++) {
+            w->sum_w += s_w[lane];
+            w->sum_w2 += s_w2[lane];
+            w->sum_x += s_x[lane];
+            w->sum_y += s_y[lane];
+            w->sum_xx += s_xx[lane];
+            w->sum_xy += s_xy[lane];
+            w->sum_yy += s_yy[lane];
+            w->sum_vx += s_vx[lane];
+            w->sum_vy += s_vy[lane];
+        }
+    }
+}
+
+// Перевыборка с малой дисперсией (systematic): точки (u0 + j) / N по накопленным весам.
+// Поток заполняет выходные позиции j, попадающие на его срез частиц, поэтому срезы независимы
+static void phase_resample(struct particle_filter *pf, struct pf_worker *w) {
+    double prefix = 0.0;
+    for (int t = 0; t < w->index; t++) prefix += pf->workers[t].sum_w;
+    double n = pf->count, total = pf->w_total;
+    double u0 = pf->resample_u0;
+
+    // Границы выходного диапазона считаются одинаково для соседних потоков: без пропусков и наложений
+    double j_first = ceil(prefix / total * n - u0);
+    double j_last = w->index == pf->thread_count - 1 ? n : ceil((prefix + w->sum_w) / total * n - u0);
+    uint32_t j = j_first < 0 ? 0 : (j_first > n ? n : (uint32_t)j_first);
+    uint32_t j_end = j_last < 0 ? 0 : (j_last > n ? n : (uint32_t)j_last);
+
+    uint32_t k = w->first;
+    double cum = prefix + pf->w[k];
+    for (; j < j_end; j++) {
+        double target = (u0 + j) / n * total;
+        while (cum <= target && k + 1 < w->last) {
+            cum += pf->w[++k];
+        }
+        pf->nx[j] = pf->x[k];
+        pf->ny[j] = pf->y[k];
+        pf->nvx[j] = pf->vx[k];
+        pf->nvy[j] = pf->vy[k];
+    }
+}
+
+static void run_phase(struct particle_filter *pf, struct pf_worker *w) {
+    u32x4 rng;
+    memcpy(&rng, w->rng, sizeof(rng));
+    switch (pf->phase) {
+    case PF_PHASE_INIT:
+        phase_init(pf, w, &rng);
+        break;
+    case PF_PHASE_PREDICT:
+        phase_predict(pf, w, &rng);
+        break;
+    case PF_PHASE_WEIGHT:
+        phase_weight(pf, w);
+        break;
+    case PF_PHASE_RESAMPLE:
+        phase_resample(pf, w);
+        break;
+    }
+    memcpy(w->rng, &rng, sizeof(rng));
+}
+
+static void *worker_main(void *arg) {
+    struct pf_worker *w = arg;
+    struct particle_filter *pf = w->pf;
+    for (;;) {
+        pthread_barrier_wait(&pf->start);
+        if (pf->phase == PF_PHASE_EXIT) {
+            return NULL;
+        }
+        run_phase(pf, w);
+        pthread_barrier_wait(&pf->done);
+    }
+}
+
+// Фаза выполняется всеми потоками, главный поток обрабатывает нулевой срез
+static void run_parallel(struct particle_filter *pf, int phase) {
+    pf->phase = phase;
+    if (pf->thread_count > 1) pthread_barrier_wait(&pf->start);
+    run_phase(pf, &pf->workers[0]);
+    if (pf->thread_count > 1) pthread_barrier_wait(&pf->done);
+}
+
+static void pin_thread(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// Буферы частиц и потоки создаются один раз. threads = 0 - по потоку на ядро, разрешенное процессу.
+// Потоки закрепляются на своих ядрах, только если процесс закрепил launcher (RT_CPUS_ENV, список
+// ядер сервиса в launcher.conf); при запуске без launcher распределение оставляется планировщику
+int pf_init(struct particle_filter *pf, uint32_t count, int threads) {
+    memset(pf, 0, sizeof(*pf));
+
+    cpu_set_t allowed;
+    int cpus[PF_MAX_THREADS];
+    int cpu_count = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && cpu_count < PF_MAX_THREADS; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) cpus[cpu_count++] = cpu;
+        }
+    }
+    const char *launcher_cpus = getenv(RT_CPUS_ENV);
+    int pinned = threads <= 0 && launcher_cpus && launcher_cpus[0];
+    if (threads <= 0) threads = cpu_count;
+    if (threads < 1) threads = 1;
+    if (threads > PF_MAX_THREADS) threads = PF_MAX_THREADS;
+    pf->thread_count = threads;
+
+    uint32_t granule = PF_LANES * threads;
+    if (count == 0 || count > PF_MAX_PARTICLES) count = PF_DEFAULT_PARTICLES;
+    count = (count + granule - 1) / granule * granule;
+    pf->count = count;
+
+    pf->buffer = aligned_alloc(64, (size_t)count * 10 * sizeof(float));
+    if (!pf->buffer) {
+        perror("Ошибка выделения памяти фильтра частиц");
+        return -1;
+    }
+    memset(pf->buffer, 0, (size_t)count * 10 * sizeof(float));
+    float **arrays[] = {&pf->x, &pf->y, &pf->vx, &pf->vy, &pf->w, &pf->ll,
+                        &pf->nx, &pf->ny, &pf->nvx, &pf->nvy};
+    for (int i = 0; i < 10; i++) *arrays[i] = pf->buffer + (size_t)count * i;
+    pf->resample_seed = 1;
+
+    uint32_t slice = count / threads;
+    for (int t = 0; t < threads; t++) {
+        struct pf_worker *w = &pf->workers[t];
+        w->pf = pf;
+        w->index = t;
+        w->first = slice * t;
+        w->last = slice * (t + 1);
+        for (int lane = 0; lane < PF_LANES; lane++) w->rng[lane] = 2463534242u + 7919u * (t * PF_LANES + lane + 1);
+    }
+
+    if (threads > 1) {
+        pthread_barrier_init(&pf->start, NULL, threads);
+        pthread_barrier_init(&pf->done, NULL, threads);
+        if (pinned) pin_thread(pthread_self(), cpus[0]);
+        for (int t = 1; t < threads; t++) {
+            if (pthread_create(&pf->workers[t].thread, NULL, worker_main, &pf->workers[t]) != 0) {
+                perror("Ошибка создания потока фильтра частиц");
+                return -1;
+            }
+            if (pinned) pin_thread(pf->workers[t].thread, cpus[t]);
+        }
+    }
+    printf("[PARTICLE] %u particles, %d threads%s\n", pf->count, threads, pinned && threads > 1 ? ", pinned" : "");
+    return 0;
+}
+
+// Перевод вышек снимка в наблюдения: дальность по уровню сигнала и кольцо TA
+static uint8_t build_observations(struct particle_filter *pf, const tower_info_t *towers, int count) {
+    uint8_t n = 0;
+    for (int k = 0; k < count && n < PF_MAX_TOWERS; k++) {
+        if (towers[k].LAT == 0.0f && towers[k].LONG == 0.0f) {
+            continue;
+        }
+        struct pf_observation *o = &pf->obs[n++];
+        o->x = (towers[k].LAT - pf->lat0) * pf->m_per_deg_lat;
+        o->y = (towers[k].LONG - pf->lon0) * pf->m_per_deg_lon;
+        o->log2_range = log2(signal_to_distance(towers[k].receive_level, 1800) + 1.0);
+        double ta_min, ta_max;
+        if (ta_to_annulus(towers[k].TA, &ta_min, &ta_max) == 0) {
+            o->ta_min = ta_min;
+            o->ta_max = ta_max;
+        } else {
+            o->ta_min = o->ta_max = -1.0f;
+        }
+    }
+    return n;
+}
+
+// Одно обновление: прогноз на dt, взвешивание по всем вышкам снимка (даже одной),
+// оценка и перевыборка при вырождении весов. Без вышек - только прогноз
+int pf_update(struct particle_filter *pf, const tower_info_t *towers, int count, double dt,
+              struct pf_estimate *estimate) {
+    long start_us = monotonic_us();
+    memset(estimate, 0, sizeof(*estimate));
+
+    if (!pf->initialized) {
+        // Начало координат и облако частиц - вокруг вышек первого снимка с найденными координатами
+        double lat = 0.0, lon = 0.0;
+        int valid = 0;
+        for (int k = 0; k < count; k++) {
+            if (towers[k].LAT == 0.0f && towers[k].LONG == 0.0f) continue;
+            lat += towers[k].LAT;
+            lon += towers[k].LONG;
+            valid++;
+        }
+        if (valid == 0) {
+            return -1;
+        }
+        pf->lat0 = lat / valid;
+        pf->lon0 = lon / valid;
+        pf->m_per_deg_lat = deg_to_rad(1.0) * EARTH_RADIUS;
+        pf->m_per_deg_lon = pf->m_per_deg_lat * cos(deg_to_rad(pf->lat0));
+
+        // Квадрат частиц накрывает окрестность каждой вышки: PF_INIT_SPREAD_M, а для вышки
+        // с известным TA - все кольцо TA (до ~35 км). Иначе при удаленных или лежащих по одну
+        // сторону вышках истинное положение могло оказаться вне облака, и фильтр не сходился бы
+        double spread = PF_INIT_SPREAD_M;
+        for (int k = 0; k < count; k++) {
+            if (towers[k].LAT == 0.0f && towers[k].LONG == 0.0f) continue;
+            double reach = PF_INIT_SPREAD_M, ta_min, ta_max;
+            if (ta_to_annulus(towers[k].TA, &ta_min, &ta_max) == 0 && ta_max > reach) reach = ta_max;
+            double dn = fabs(towers[k].LAT - pf->lat0) * pf->m_per_deg_lat;
+            double de = fabs(towers[k].LONG - pf->lon0) * pf->m_per_deg_lon;
+            spread = fmax(spread, fmax(dn, de) + reach);
+        }
+        pf->init_spread_m = spread;
+        pf->mean_x = pf->mean_y = 0.0;
+        pf->w_total = pf->count;
+        run_parallel(pf, PF_PHASE_INIT);
+        pf->initialized = 1;
+        dt = 0.0;
+    }
+
+    if (dt < PF_MIN_DT_S) dt = dt <= 0.0 ? 0.0 : PF_MIN_DT_S;
+    if (dt > PF_MAX_DT_S) dt = PF_MAX_DT_S;
+    pf->dt = dt;
+    pf->obs_count = build_observations(pf, towers, count);
+    run_parallel(pf, PF_PHASE_PREDICT);
+
+    pf->ll_max = -INFINITY;
+    for (int t = 0; t < pf->thread_count; t++) {
+        if (pf->workers[t].ll_max > pf->ll_max) pf->ll_max = pf->workers[t].ll_max;
+    }
+    run_parallel(pf, PF_PHASE_WEIGHT);
+
+    double sum_w = 0.0, sum_w2 = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0, sum_yy = 0.0;
+    double sum_vx = 0.0, sum_vy = 0.0;
+    for (int t = 0; t < pf->thread_count; t++) {
+        const struct pf_worker *w = &pf->workers[t];
+        sum_w += w->sum_w;
+        sum_w2 += w->sum_w2;
+        sum_x += w->sum_x;
+        sum_y += w->sum_y;
+        sum_xx += w->sum_xx;
+        sum_xy += w->sum_xy;
+        sum_yy += w->sum_yy;
+        sum_vx += w->sum_vx;
+        sum_vy += w->sum_vy;
+    }
+    pf->w_total = sum_w;
+
+    double dx = sum_x / sum_w, dy = sum_y / sum_w;
+    pf->mean_x += dx;
+    pf->mean_y += dy;
+    estimate->fix.location.latitude = pf->lat0 + pf->mean_x / pf->m_per_deg_lat;
+    estimate->fix.location.longitude = pf->lon0 + pf->mean_y / pf->m_per_deg_lon;
+    estimate->fix.cov_nn = sum_xx / sum_w - dx * dx;
+    estimate->fix.cov_ne = sum_xy / sum_w - dx * dy;
+    estimate->fix.cov_ee = sum_yy / sum_w - dy * dy;
+    estimate->speed_mps = sqrt(sum_vx * sum_vx + sum_vy * sum_vy) / sum_w;
+    estimate->ess = sum_w * sum_w / sum_w2;
+    estimate->observations = pf->obs_count;
+
+    if (estimate->ess < PF_RESAMPLE_RATIO * pf->count) {
+        pf->resample_u0 = rand_r(&pf->resample_seed) / (RAND_MAX + 1.0);
+        run_parallel(pf, PF_PHASE_RESAMPLE);
+        float *swap;
+        swap = pf->x; pf->x = pf->nx; pf->nx = swap;
+        swap = pf->y; pf->y = pf->ny; pf->ny = swap;
+        swap = pf->vx; pf->vx = pf->nvx; pf->nvx = swap;
+        swap = pf->vy; pf->vy = pf->nvy; pf->nvy = swap;
+        for (uint32_t i = 0; i < pf->count; i++) pf->w[i] = 1.0f;
+        pf->w_total = pf->count;
+        estimate->resampled = 1;
+    }
+
+    estimate->update_us = monotonic_us() - start_us;
+    return 0;
+}
+
+void pf_free(struct particle_filter *pf) {
+    if (pf->thread_count > 1 && pf->buffer) {
+        pf->phase = PF_PHASE_EXIT;
+        pthread_barrier_wait(&pf->start);
+        for (int t = 1; t < pf->thread_count; t++) pthread_join(pf->workers[t].thread, NULL);
+        pthread_barrier_destroy(&pf->start);
+        pthread_barrier_destroy(&pf->done);
+    }
+    free(pf->buffer);
+    memset(pf, 0, sizeof(*pf));
+}
@@ -0,0 +1,83 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "msg_definitions.h"
+#include "geoprocessing.h"
+
+#define PF_LANES 4                    // Ширина векторного ядра (128 бит NEON/SSE): частиц за одну операцию
+#define PF_DEFAULT_PARTICLES 16384
+#define PF_MAX_PARTICLES (1 << 20)
+#define PF_MAX_THREADS 4              // Потоков обновления, не больше ядер, разрешенных процессу
+#define PF_MAX_TOWERS 7
+#define PF_INIT_SPREAD_M 3000.0       // Наименьший начальный разброс частиц вокруг вышек, м
+#define PF_INIT_SPEED_MPS 15.0        // СКО начальной скорости, м/с
+#define PF_ACCEL_SIGMA 2.0            // СКО ускорения в модели движения, м/с^2
+#define PF_RXLEV_SIGMA_DB 8.0         // СКО уровня сигнала относительно модели signal_to_distance, дБ
+#define PF_TA_SIGMA_M 100.0           // Мягкость границ кольца TA, м
+#define PF_RESAMPLE_RATIO 0.5         // Перевыборка, когда эффективное число частиц ниже доли от всех
+#define PF_MIN_DT_S 0.05
+#define PF_MAX_DT_S 2.0
+
+// Оценка фильтра после обновления
+struct pf_estimate {
+    struct position_fix fix;  // Взвешенное среднее и ковариация частиц, м^2
+    double speed_mps;         // Модуль средней скорости частиц, м/с
+    double ess;               // Эффективное число частиц до перевыборки
+    uint8_t observations;     // Вышек, учтенных в обновлении
+    uint8_t resampled;
+    long update_us;           // Время обновления (реальное), мкс
+};
+
+struct pf_worker {
+    struct particle_filter *pf;
+    pthread_t thread;
+    int index;
+    uint32_t first, last;     // Срез частиц потока [first, last)
+    uint32_t rng[PF_LANES];   // Состояние xorshift по дорожкам вектора
+    float ll_max;             // Результаты фаз, собираются главным потоком
+    double sum_w, sum_w2, sum_x, sum_y, sum_xx, sum_xy, sum_yy, sum_vx, sum_vy;
+};
+
+// Наблюдение одной вышки в локальной системе координат фильтра
+struct pf_observation {
+    float x, y;               // Вышка, м (север, восток)
+    float log2_range;         // log2 дальности по уровню сигнала
+    float ta_min, ta_max;     // Кольцо TA, ta_max < 0 - нет
+};
+
+// Фильтр частиц: состояния в структуре массивов, по PF_LANES частиц на вектор.
+// Все буферы и потоки создаются в pf_init, обновление не выделяет память
+struct particle_filter {
+    uint32_t count;
+    float *buffer;            // Все массивы - в одном выровненном блоке
+    float *x, *y, *vx, *vy;   // Положение (север, восток, м от начала координат) и скорость
+    float *w, *ll;            // Веса и логарифм правдоподобия текущего обновления (log2)
+    float *nx, *ny, *nvx, *nvy;  // Буферы перевыборки
+    int initialized;
+    float init_spread_m;      // Полуширина начального квадрата частиц, м
+    double lat0, lon0, m_per_deg_lat, m_per_deg_lon;
+    double mean_x, mean_y;    // Последняя оценка: начало отсчета для сумм ковариации
+
+    // Параметры текущей фазы, читаются потоками между барьерами
+    int phase;
+    float dt;
+    struct pf_observation obs[PF_MAX_TOWERS];
+    uint8_t obs_count;
+    float ll_max;
+    float resample_u0;        // Смещение сетки перевыборки
+    unsigned int resample_seed;
+    double w_total;
+
+    int thread_count;
+    struct pf_worker workers[PF_MAX_THREADS];
+    pthread_barrier_t start, done;
+};
+
+int pf_init(struct particle_filter *pf, uint32_t count, int threads);
+int pf_update(struct particle_filter *pf, const tower_info_t *towers, int count, double dt,
+              struct pf_estimate *estimate);
+void pf_free(struct particle_filter *pf);
+
+#endif
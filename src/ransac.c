@@ -0,0 +1,212 @@
+#include "ransac.h"
+#include "geoprocessing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Процессорное время текущего потока в микросекундах
+static long thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+// Допуск невязки для вышки с дальностью r
+static double inlier_threshold(double r) {
+    double rel = RANSAC_INLIER_REL * r;
+    return rel > RANSAC_INLIER_ABS_M ? rel : RANSAC_INLIER_ABS_M;
+}
+
+// Кольцо дальности по TA первой вышки, для которой TA известен (обслуживающая вышка).
+// Индекс в constraint - в массиве towers; возвращает -1, если ни у одной вышки TA нет
+int ransac_range_constraint(const tower_info_t *towers, uint8_t count,
+                            struct range_constraint *constraint) {
+    constraint->tower = -1;
+    for (uint8_t k = 0; k < count; k++) {
+        if (towers[k].LAT == 0.0f && towers[k].LONG == 0.0f) {
+            continue;
+        }
+        if (ta_to_annulus(towers[k].TA, &constraint->min_m, &constraint->max_m) == 0) {
+            constraint->tower = k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Гипотеза вне кольца TA (с допуском) - физически невозможна, консенсус не считаем
+static int outside_annulus(struct Location loc, double lat, double lon,
+                           const struct range_constraint *constraint) {
+    double dist = haversine(loc.latitude, loc.longitude, lat, lon);
+    return dist < constraint->min_m - RANSAC_TA_MARGIN_M ||
+           dist > constraint->max_m + RANSAC_TA_MARGIN_M;
+}
+
+// Оценка гипотезы: число согласных вышек и усеченная сумма квадратов невязок (MSAC)
+static uint8_t score_hypothesis(struct Location loc, const double *lat, const double *lon,
+                                const double *r, uint8_t count, uint8_t *mask, double *cost) {
+    uint8_t consensus = 0;
+    *cost = 0.0;
+    for (uint8_t k = 0; k < count; k++) {
+        double res = fabs(haversine(loc.latitude, loc.longitude, lat[k], lon[k]) - r[k]);
+        double thr = inlier_threshold(r[k]);
+        if (res < thr) {
+            mask[k] = 1;
+            consensus++;
+            *cost += res * res;
+        } else {
+            mask[k] = 0;
+            *cost += thr * thr;
+        }
+    }
+    return consensus;
+}
+
+#if RANSAC_MAX_TOWERS * (RANSAC_MAX_TOWERS - 1) * (RANSAC_MAX_TOWERS - 2) / 6 > RANSAC_MAX_HYPOTHESES
+#error "RANSAC_MAX_TOWERS too large for exhaustive search"
+#endif
+
+// Отбраковка выбросов: перебор всех минимальных подмножеств по 3 вышки (не больше
+// RANSAC_MAX_HYPOTHESES), выбор гипотезы с наибольшим консенсусом.
+// В inliers копируются вышки, согласные с лучшей гипотезой.
+uint8_t ransac_select_inliers(const tower_info_t *towers, uint8_t count,
+                              tower_info_t *inliers, struct ransac_stats *stats) {
+    long start_us = thread_cpu_us();
+
+    if (count > RANSAC_MAX_TOWERS) count = RANSAC_MAX_TOWERS;
+    memset(stats, 0, sizeof(*stats));
+    stats->total = count;
+
+    // Кольцо TA обслуживающей вышки: ее дальность приводится в кольцо, гипотезы вне него отбрасываются
+    struct range_constraint ta;
+    ransac_range_constraint(towers, count, &ta);
+
+    // Вышки, не найденные в БД (0,0), сразу отбрасываем
+    uint8_t index[RANSAC_MAX_TOWERS];
+    int ta_valid = -1;
+    double lat[RANSAC_MAX_TOWERS], lon[RANSAC_MAX_TOWERS], r[RANSAC_MAX_TOWERS];
+    uint8_t valid = 0;
+    for (uint8_t k = 0; k < count; k++) {
+        if (towers[k].LAT == 0.0f && towers[k].LONG == 0.0f) {
+            continue;
+        }
+        index[valid] = k;
+        lat[valid] = towers[k].LAT;
+        lon[valid] = towers[k].LONG;
+        r[valid] = signal_to_distance(towers[k].receive_level, 1800);
+        if (ta.tower == k) {
+            ta_valid = valid;
+            r[valid] = clamp_range(r[valid], &ta, k);
+        }
+        valid++;
+    }
+    stats->valid = valid;
+
+    if (valid < RANSAC_SUBSET_SIZE) {
+        for (uint8_t k = 0; k < valid; k++) inliers[k] = towers[index[k]];
+        stats->inliers = valid;
+        stats->cpu_us = thread_cpu_us() - start_us;
+        return valid;
+    }
+
+    uint8_t best_mask[RANSAC_MAX_TOWERS] = {0};
+    uint8_t best_subset[RANSAC_SUBSET_SIZE] = {0};
+    uint8_t best_consensus = 0;
+    double best_cost = INFINITY;
+    uint8_t a = 0, b = 1, c = 2;
+
+    for (;;) {
+        if (thread_cpu_us() - start_us > RANSAC_TIME_BUDGET_US) {
+            stats->budget_hit = 1;
+            break;
+        }
+
+        double slat[3] = {lat[a], lat[b], lat[c]};
+        double slon[3] = {lon[a], lon[b], lon[c]};
+        double sr[3] = {r[a], r[b], r[c]};
+        struct Location loc;
+        stats->hypotheses++;
+        int solved = trilaterate_3(slat, slon, sr, &loc) == 0;
+        if (solved && ta_valid >= 0 && outside_annulus(loc, lat[ta_valid], lon[ta_valid], &ta)) {
+            stats->pruned++;
+        } else if (solved) {
+            uint8_t mask[RANSAC_MAX_TOWERS];
+            double cost;
+            uint8_t consensus = score_hypothesis(loc, lat, lon, r, valid, mask, &cost);
+            if (consensus > best_consensus || (consensus == best_consensus && cost < best_cost)) {
+                best_consensus = consensus;
+                best_cost = cost;
+                memcpy(best_mask, mask, sizeof(mask));
+                best_subset[0] = a;
+                best_subset[1] = b;
+                best_subset[2] = c;
+            }
+        }
+
+        // Следующее сочетание a < b < c
+        if (++c < valid) continue;
+        if (++b < valid - 1) { c = b + 1; continue; }
+        if (++a < valid - 2) { b = a + 1; c = b + 1; continue; }
+        break;
+    }
+
+    // Консенсус меньше минимального подмножества: берем само лучшее подмножество
+    if (best_consensus < RANSAC_SUBSET_SIZE && best_cost < INFINITY) {
+        memset(best_mask, 0, sizeof(best_mask));
+        for (int k = 0; k < RANSAC_SUBSET_SIZE; k++) best_mask[best_subset[k]] = 1;
+    }
+
+    // Все гипотезы отброшены по кольцу TA: отбраковку не применяем, решатель получит все вышки
+    if (best_cost == INFINITY) {
+        memset(best_mask, 1, sizeof(best_mask));
+    }
+
+    uint8_t n = 0;
+    for (uint8_t k = 0; k < valid; k++) {
+        if (best_mask[k]) inliers[n++] = towers[index[k]];
+    }
+    stats->inliers = n;
+    stats->cpu_us = thread_cpu_us() - start_us;
+    return n;
+}
+
+// Решение снимка, общее для cordcalculation и ta_bench: отбраковка выбросов, начальное
+// приближение по трем первым согласным вышкам, затем уточнение по всем (если вышек больше трех
+// или известно кольцо TA). Ковариация известна только после уточнения, иначе NAN.
+// При вырожденной системе уточнения остается решение по трем вышкам.
+// Возвращает 0 или -1, если согласных вышек меньше трех либо три вышки не дают решения
+int ransac_solve(const tower_info_t *towers, uint8_t count, struct position_fix *fix,
+                 struct ransac_solution *solution) {
+    tower_info_t inliers[RANSAC_MAX_TOWERS];
+    memset(solution, 0, sizeof(*solution));
+    fix->cov_nn = fix->cov_ne = fix->cov_ee = NAN;
+    solution->used = ransac_select_inliers(towers, count, inliers, &solution->stats);
+    if (solution->used < RANSAC_SUBSET_SIZE) {
+        return -1;
+    }
+
+    // Кольцо TA обслуживающей вышки ограничивает ее дальность и область поиска решателя
+    struct range_constraint ta;
+    solution->constrained = ransac_range_constraint(inliers, solution->used, &ta) == 0;
+
+    double lat[RANSAC_MAX_TOWERS], lon[RANSAC_MAX_TOWERS], r[RANSAC_MAX_TOWERS];
+    for (uint8_t k = 0; k < solution->used; k++) {
+        lat[k] = inliers[k].LAT;
+        lon[k] = inliers[k].LONG;
+        r[k] = clamp_range(signal_to_distance(inliers[k].receive_level, 1800), &ta, k);
+    }
+    if (trilaterate_3(lat, lon, r, &fix->location) != 0) {
+        return -1;
+    }
+    if (solution->used > RANSAC_SUBSET_SIZE || solution->constrained) {
+        struct position_fix initial = *fix;
+        solution->iterations = refine_least_squares(lat, lon, r, solution->used,
+                                                    solution->constrained ? &ta : NULL, fix);
+        if (solution->iterations < 0) {
+            *fix = initial;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef RANSAC_H
+#define RANSAC_H
+
+#include <stdint.h>
+#include "msg_definitions.h"
+#include "geoprocessing.h"
+
+#define RANSAC_MAX_TOWERS 7           // Вышек в одном снимке AT+CENG? не больше 7
+#define RANSAC_SUBSET_SIZE 3          // Минимальное подмножество для трилатерации
+#define RANSAC_MAX_HYPOTHESES 35      // C(7,3): при RANSAC_MAX_TOWERS всегда перебираются все тройки
+#define RANSAC_TIME_BUDGET_US 20000   // Жесткий предел процессорного времени: 10% цикла 200мс
+#define RANSAC_INLIER_ABS_M 150.0     // Допуск невязки дальности, м
+#define RANSAC_INLIER_REL 0.5         // Допуск невязки относительно дальности
+#define RANSAC_TA_MARGIN_M 150.0      // Допуск выхода гипотезы за кольцо TA до отбрасывания, м
+
+// Статистика одного прохода отбраковки
+struct ransac_stats {
+    uint8_t total;        // Вышек на входе
+    uint8_t valid;        // Вышек с найденными координатами (не 0,0)
+    uint8_t inliers;      // Вышек, переданных в итоговый решатель
+    uint16_t hypotheses;  // Проверено гипотез
+    uint16_t pruned;      // Гипотез, отброшенных по кольцу TA без оценки консенсуса
+    long cpu_us;          // Затрачено процессорного времени, мкс
+    uint8_t budget_hit;   // 1, если перебор прерван по лимиту времени
+};
+
+// Итог решения снимка (ransac_solve)
+struct ransac_solution {
+    struct ransac_stats stats;
+    uint8_t used;         // Вышек в итоговом решателе (согласных после отбраковки)
+    uint8_t constrained;  // Учтено кольцо TA обслуживающей вышки
+    int iterations;       // Итераций уточнения: 0 - не выполнялось, -1 - вырожденная система
+};
+
+int ransac_range_constraint(const tower_info_t *towers, uint8_t count,
+                             struct range_constraint *constraint);
+uint8_t ransac_select_inliers(const tower_info_t *towers, uint8_t count,
+                              tower_info_t *inliers, struct ransac_stats *stats);
+int ransac_solve(const tower_info_t *towers, uint8_t count, struct position_fix *fix,
+                 struct ransac_solution *solution);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RTMEM_H
+#define RTMEM_H
+
+#include <stddef.h>
+
+#define RT_STACK_PREFAULT_SIZE (64 * 1024)   // Сколько стека заранее отобразить в память
+#define RT_STDOUT_BUFFER_SIZE 8192           // Статический буфер stdout вместо выделяемого stdio
+#define RT_READY_FD_ENV "MIKBSN_READY_FD"    // Дескриптор, в который launcher ждет уведомление о готовности
+#define RT_MLOCK_ENV "MIKBSN_MLOCK"          // "0" - не вызывать mlockall
+#define RT_CPUS_ENV "MIKBSN_CPUS"            // Ядра, на которых launcher закрепил сервис; нет - не закреплен
+
+// Пул блоков фиксированного размера, выделяемый один раз при запуске
+struct mempool {
+    char *base;
+    size_t item_size;
+    size_t capacity;
+    size_t used;          // Сколько блоков выдано из base до первого освобождения
+    void *free_list;      // Освобожденные блоки
+};
+
+int mempool_init(struct mempool *pool, size_t item_size, size_t capacity);
+void *mempool_alloc(struct mempool *pool);
+void mempool_free(struct mempool *pool, void *item);
+void mempool_destroy(struct mempool *pool);
+
+void rt_setup_stdio(void);
+void rt_ready(const char *service);
+
+#endif
@@ -4,84 +4,469 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <math.h>
+#include <time.h>
 #include <termios.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/select.h>
+#include <sys/resource.h>
 #include "geoprocessing.h"
 #include "hashutils.h"
 #include "msg_definitions.h"
 #include "config.h"
+#include "rtmem.h"
+#include "capture.h"
+#include "checkpoint.h"
 
 #define SOCKET_PATH "/tmp/gsm_socket"
+#define UART_LINE_SIZE 256
+#define SNAPSHOT_BUFFER_SIZE 2048
+#define CENG_LAST_CELL_INDEX 6   // AT+CENG=x,1 выдает обслуживающую и 6 соседних вышек
+#define CHECKPOINT_PATH "sim_handler.ckpt"
+
+// Состояние между запусками: скорость, на которую модем переключен AT+IPR.
+// Модем не сбрасывается вместе с сервисом и после перезапуска отвечает уже на ней
+struct sim_handler_state {
+    int32_t baud;
+};
 
 size_t DBSIZE;
 
+// Счетчики для сравнения режимов опроса
+struct uart_stats {
+    unsigned long rx_bytes;
+    unsigned long tx_bytes;
+    unsigned long snapshots;
+    unsigned long queries;
+    // Обратная связь от cordcalculation (адаптивный опрос)
+    unsigned long feedbacks;
+    unsigned long no_fix;
+    unsigned long hacc_count;
+    double hacc_sum;
+    double speed_sum;
+};
+
+static struct uart_stats stats;
+
+// Сборка строк из потока UART и снимков из строк +CENG
+static char line_buffer[UART_LINE_SIZE];
+static size_t line_length = 0;
+static char snapshot_buffer[SNAPSHOT_BUFFER_SIZE];
+static size_t snapshot_length = 0;
+static int snapshot_ready = 0;
+static char pending_line[UART_LINE_SIZE];
+static char rx_buffer[512];
+static size_t rx_start = 0, rx_end = 0;
+
+// Запись обмена с SIM800 (--record) и воспроизведение вместо UART (--replay)
+static struct capture recorder = {.fd = -1};
+static struct capture player = {.fd = -1};
+static int replaying = 0;
+static int replay_finished = 0;
+
+// Адаптивный опрос: последняя обратная связь и текущий интервал между AT+CENG?
+static int control_socket = -1;
+static long last_feedback_ms = 0;
+static double query_interval_ms = SIM_QUERY_MIN_INTERVAL_MS;
+
+// Текущее время CLOCK_MONOTONIC в миллисекундах
+static long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
 // Функция для отправки команды на SIM800
 void send_command(int uart_fd, const char *command) {
     printf("Отправка команды: %s\n", command);
+    if (replaying) {
+        return;
+    }
+    capture_write(&recorder, CAPTURE_STREAM_UART_TX, command, strlen(command));
     if (write(uart_fd, command, strlen(command)) == -1) {
         perror("Ошибка при отправке команды на SIM800");
         exit(EXIT_FAILURE);
     }
+    stats.tx_bytes += strlen(command);
 }
 
-// Функция для получения ответа от SIM800 с отладочным выводом
-int read_response(int uart_fd, char *buffer, size_t buffer_size) {
-    int total_bytes_read = 0;
-    int bytes_read;
+// Перевод числовой скорости в константу termios
+static speed_t baud_to_speed(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+// Настройка скорости и формата кадра UART (8N1)
+static int configure_uart(int uart_fd, int baud) {
+    speed_t speed = baud_to_speed(baud);
+    if (speed == B0) {
+        fprintf(stderr, "Неподдерживаемая скорость UART: %d\n", baud);
+        return -1;
+    }
+    struct termios options;
+    tcgetattr(uart_fd, &options);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    options.c_cflag |= (CLOCAL | CREAD);
+    options.c_cflag &= ~PARENB;
+    options.c_cflag &= ~CSTOPB;
+    options.c_cflag &= ~CSIZE;
+    options.c_cflag |= CS8;
+    return tcsetattr(uart_fd, TCSANOW, &options);
+}
+
+// Обработка одной строки от модуля. Строки +CENG копятся в снимок,
+// снимок закрывается последней соседней вышкой, OK или началом следующего снимка.
+// Возвращает 1 для OK, -1 для ERROR, иначе 0.
+static int handle_line(const char *line) {
+    if (strcmp(line, "OK") == 0) {
+        if (snapshot_length > 0) snapshot_ready = 1;
+        return 1;
+    }
+    if (strcmp(line, "ERROR") == 0) {
+        return -1;
+    }
+    int cell_index;
+    if (sscanf(line, "+CENG: %d,\"", &cell_index) != 1 || strchr(line, '"') == NULL) {
+        return 0;   // эхо команды, заголовок "+CENG: 1,1" и т.п.
+    }
+    // Начался новый снимок, а предыдущий не был закрыт: строку откладываем до сброса снимка
+    if (cell_index == 0 && snapshot_length > 0) {
+        strncpy(pending_line, line, sizeof(pending_line) - 1);
+        snapshot_ready = 1;
+        return 0;
+    }
+    size_t len = strlen(line);
+    if (snapshot_length + len + 2 < sizeof(snapshot_buffer)) {
+        memcpy(snapshot_buffer + snapshot_length, line, len);
+        snapshot_length += len;
+        snapshot_buffer[snapshot_length++] = '\r';
+        snapshot_buffer[snapshot_length++] = '\n';
+        snapshot_buffer[snapshot_length] = '\0';
+    }
+    if (cell_index >= CENG_LAST_CELL_INDEX) {
+        snapshot_ready = 1;
+    }
+    return 0;
+}
+
+// Сброс обработанного снимка; отложенная строка открывает следующий
+static void reset_snapshot(void) {
+    snapshot_length = 0;
+    snapshot_buffer[0] = '\0';
+    snapshot_ready = 0;
+    if (pending_line[0] != '\0') {
+        char line[UART_LINE_SIZE];
+        memcpy(line, pending_line, sizeof(line));
+        pending_line[0] = '\0';
+        handle_line(line);
+    }
+}
+
+// Разбор накопленных байт UART на строки до первого готового снимка
+static int consume_rx_buffer(void) {
+    int status = 0;
+    while (rx_start < rx_end && !snapshot_ready) {
+        char c = rx_buffer[rx_start++];
+        if (c == '\r' || c == '\n') {
+            if (line_length == 0) continue;
+            line_buffer[line_length] = '\0';
+            line_length = 0;
+            int result = handle_line(line_buffer);
+            if (result != 0) status = result;
+        } else if (line_length < UART_LINE_SIZE - 1) {
+            line_buffer[line_length++] = c;
+        }
+    }
+    return status;
+}
+
+// Чтение UART с ожиданием не дольше timeout_ms и разбор прочитанного на строки.
+// Возвращает 1 для OK, -1 для ERROR, иначе 0.
+static int read_uart(int uart_fd, long timeout_ms) {
+    int status = consume_rx_buffer();
+    if (snapshot_ready || status != 0) {
+        return status;
+    }
+
+    if (replaying) {
+        ssize_t bytes_replayed = capture_next(&player, CAPTURE_STREAM_UART_RX, rx_buffer, sizeof(rx_buffer));
+        if (bytes_replayed < 0) {
+            replay_finished = 1;
+            return 0;
+        }
+        stats.rx_bytes += bytes_replayed;
+        rx_start = 0;
+        rx_end = bytes_replayed;
+        return consume_rx_buffer();
+    }
 
     fd_set read_fds;
     FD_ZERO(&read_fds);
     FD_SET(uart_fd, &read_fds);
+    struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
 
-    // Используем select() без таймаута для немедленной обработки поступающих данных
-    int select_result = select(uart_fd + 1, &read_fds, NULL, NULL, NULL);
+    int select_result = select(uart_fd + 1, &read_fds, NULL, NULL, &tv);
     if (select_result < 0) {
-        perror("Ошибка select()");
-        return -1;
+        if (errno != EINTR) perror("Ошибка select()");
+        return 0;
+    }
+    if (select_result == 0) {
+        return 0;
+    }
+
+    ssize_t bytes_read = read(uart_fd, rx_buffer, sizeof(rx_buffer));
+    if (bytes_read < 0) {
+        if (errno != EAGAIN) perror("Ошибка при чтении из UART");
+        return 0;
+    }
+    stats.rx_bytes += bytes_read;
+    capture_write(&recorder, CAPTURE_STREAM_UART_RX, rx_buffer, bytes_read);
+    rx_start = 0;
+    rx_end = bytes_read;
+    return consume_rx_buffer();
+}
+
+// Отправка команды настройки и ожидание OK
+static int send_config_command(int uart_fd, const char *command) {
+    send_command(uart_fd, command);
+    long deadline = monotonic_ms() + SIM_CMD_TIMEOUT_MS;
+    long now;
+    while ((now = monotonic_ms()) < deadline) {
+        int status = read_uart(uart_fd, deadline - now);
+        if (status == 1) return 0;
+        if (status == -1) break;
+        if (snapshot_ready) reset_snapshot();
+    }
+    fprintf(stderr, "Модуль не подтвердил команду: %s\n", command);
+    return -1;
+}
+
+// Переключение скорости UART командой AT+IPR. При неудаче возвращаемся на исходную скорость
+static int negotiate_baud_rate(int uart_fd, int current_baud, int new_baud) {
+    if (baud_to_speed(new_baud) == B0) {
+        fprintf(stderr, "Неподдерживаемая скорость для AT+IPR: %d\n", new_baud);
+        return current_baud;
+    }
+    char command[32];
+    snprintf(command, sizeof(command), "AT+IPR=%d\r", new_baud);
+    if (send_config_command(uart_fd, command) != 0) {
+        return current_baud;
+    }
+    tcdrain(uart_fd);
+    configure_uart(uart_fd, new_baud);
+    if (send_config_command(uart_fd, "AT\r") != 0) {
+        fprintf(stderr, "Нет ответа на скорости %d, возврат на %d\n", new_baud, current_baud);
+        configure_uart(uart_fd, current_baud);
+        return current_baud;
+    }
+    printf("Скорость UART переключена на %d\n", new_baud);
+    return new_baud;
+}
+
+// Интервал опроса по одной обратной связи: время, за которое при текущей скорости набегает
+// SIM_QUERY_DRIFT_M, короче при точности хуже SIM_QUERY_HACC_TARGET_M. Без решения - минимальный
+static double feedback_interval_ms(const feedback_t *feedback) {
+    if (isinf(feedback->hacc_m)) {
+        return SIM_QUERY_MIN_INTERVAL_MS;
+    }
+    double interval = SIM_QUERY_MAX_INTERVAL_MS;
+    if (feedback->speed_mps > SIM_QUERY_STATIONARY_SPEED_MPS) {
+        interval = 1000.0 * SIM_QUERY_DRIFT_M / feedback->speed_mps;
+    }
+    if (feedback->hacc_m > SIM_QUERY_HACC_TARGET_M) {
+        interval *= SIM_QUERY_HACC_TARGET_M / feedback->hacc_m;
     }
+    return interval;
+}
+
+// Прием всех накопившихся датаграмм обратной связи. Интервал сокращается сразу,
+// а растет не быстрее SIM_QUERY_MAX_GROWTH за решение, чтобы одиночный выброс не останавливал опрос
+static void drain_feedback(long now_ms) {
+    feedback_t feedback;
+    ssize_t length;
+    while (control_socket != -1 &&
+           (length = recv(control_socket, &feedback, sizeof(feedback), MSG_DONTWAIT)) > 0) {
+        if (length != sizeof(feedback) || feedback.msg_type != MSG_TYPE_FEEDBACK) {
+            continue;
+        }
+        double interval = feedback_interval_ms(&feedback);
+        if (interval > query_interval_ms * SIM_QUERY_MAX_GROWTH) {
+            interval = query_interval_ms * SIM_QUERY_MAX_GROWTH;
+        }
+        if (interval < SIM_QUERY_MIN_INTERVAL_MS) interval = SIM_QUERY_MIN_INTERVAL_MS;
+        if (interval > SIM_QUERY_MAX_INTERVAL_MS) interval = SIM_QUERY_MAX_INTERVAL_MS;
+        query_interval_ms = interval;
+        last_feedback_ms = now_ms;
 
-    if (FD_ISSET(uart_fd, &read_fds)) {
-        // Читаем данные, если они доступны
-        while ((bytes_read = read(uart_fd, buffer + total_bytes_read, buffer_size - total_bytes_read - 1)) > 0) {
-            total_bytes_read += bytes_read;
+        stats.feedbacks++;
+        if (isinf(feedback.hacc_m)) {
+            stats.no_fix++;
+        } else if (isfinite(feedback.hacc_m)) {
+            stats.hacc_count++;
+            stats.hacc_sum += feedback.hacc_m;
         }
-        if (bytes_read < 0 && errno != EAGAIN) {
-            perror("Ошибка при чтении из UART");
+        stats.speed_sum += feedback.speed_mps;
+    }
+}
+
+// Текущий интервал адаптивного опроса; обратная связь устарела - опрос с минимальным интервалом
+static long adaptive_interval_ms(long now_ms) {
+    if (last_feedback_ms == 0 || now_ms - last_feedback_ms > SIM_FEEDBACK_TIMEOUT_MS) {
+        return SIM_QUERY_MIN_INTERVAL_MS;
+    }
+    return (long)query_interval_ms;
+}
+
+// Периодический вывод статистики: снимков в секунду, байт UART на снимок, загрузка CPU
+static void report_stats(long now_ms) {
+    static long last_ms = 0;
+    static struct uart_stats last;
+    static double last_cpu_s = 0.0;
+    if (last_ms == 0) {
+        last_ms = now_ms;
+        return;
+    }
+    if (now_ms - last_ms < SIM_STATS_PERIOD_S * 1000L) {
+        return;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                   usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    double period_s = (now_ms - last_ms) / 1000.0;
+    unsigned long snapshots = stats.snapshots - last.snapshots;
+    unsigned long bytes = (stats.rx_bytes - last.rx_bytes) + (stats.tx_bytes - last.tx_bytes);
+
+    unsigned long feedbacks = stats.feedbacks - last.feedbacks;
+    unsigned long hacc_count = stats.hacc_count - last.hacc_count;
+
+    printf("[STATS] mode=%s snapshots/s=%.2f uart_bytes/snapshot=%.0f queries=%lu cpu=%.1f%%\n",
+           SIM_CENG_MODE == SIM_CENG_MODE_ADAPTIVE ? "adaptive" :
+           SIM_CENG_MODE == SIM_CENG_MODE_URC ? "urc" : "poll",
+           snapshots / period_s, snapshots ? (double)bytes / snapshots : 0.0,
+           stats.queries - last.queries, 100.0 * (cpu_s - last_cpu_s) / period_s);
+    // Качество решений по обратной связи cordcalculation: доля снимков без решения и средняя точность
+    if (feedbacks > 0) {
+        printf("[STATS] fixes=%lu no_fix=%lu hacc_mean=%.0fm speed_mean=%.1fm/s",
+               feedbacks, stats.no_fix - last.no_fix,
+               hacc_count ? (stats.hacc_sum - last.hacc_sum) / hacc_count : NAN,
+               (stats.speed_sum - last.speed_sum) / feedbacks);
+        if (SIM_CENG_MODE == SIM_CENG_MODE_ADAPTIVE) {
+            printf(" interval=%ldms", adaptive_interval_ms(now_ms));
+        }
+        printf("\n");
+    }
+
+    last = stats;
+    last_ms = now_ms;
+    last_cpu_s = cpu_s;
+}
+
+// Отправка вышек снимка через UNIX-сокет и маркера конца снимка
+static int send_snapshot(int client_socket, struct celltower *towers, uint8_t parsed_count) {
+    for (int i = 0; i < parsed_count; i++) {
+        level_data_t level_data;
+
+        level_data.msg_type = MSG_TYPE_TOWER;
+        level_data.MCC = towers[i].MCC;
+        level_data.MNC = towers[i].MNC;
+        level_data.CID = towers[i].CID;
+        level_data.receive_level = towers[i].RECEIVELEVEL;
+        level_data.TA = towers[i].TA;
+
+        printf("Отправка данных вышки через сокет: MCC=%d, MNC=%d, CID=%d, Уровень сигнала=%d, TA=%d\n",
+               level_data.MCC, level_data.MNC, level_data.CID, level_data.receive_level, level_data.TA);
+
+        if (send(client_socket, &level_data, sizeof(level_data), MSG_NOSIGNAL) == -1) {
             return -1;
         }
     }
 
-    if (total_bytes_read == 0) {
-        fprintf(stderr, "Ошибка: получен пустой ответ от SIM800\n");
+    // Маркер конца снимка: по нему cordcalculation считает положение по всем вышкам сразу
+    level_data_t end_msg = {.msg_type = MSG_TYPE_SNAPSHOT_END};
+    if (parsed_count > 0 && send(client_socket, &end_msg, sizeof(end_msg), MSG_NOSIGNAL) == -1) {
         return -1;
     }
-
-    buffer[total_bytes_read] = '\0';
-    printf("Получен полный ответ от SIM800 (всего байт: %d):\n%s\n", total_bytes_read, buffer);
-    return total_bytes_read;
+    return 0;
 }
 
-int main() {
-    // Настройка UART
-    int uart_fd = open(SIM_UART_PATH, O_RDWR | O_NOCTTY | O_NDELAY);
-    if (uart_fd == -1) {
-        perror("Ошибка открытия UART");
+int main(int argc, char **argv) {
+    rt_setup_stdio();
+    long start_ms = monotonic_ms();
+
+    struct capture_options capture_options;
+    if (capture_parse_args(argc, argv, &capture_options) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (capture_options.record_path && capture_open_record(&recorder, capture_options.record_path) != 0) {
         exit(EXIT_FAILURE);
     }
-    printf("Opening UART on %s\n", SIM_UART_PATH); 
 
-    struct termios options;
-    tcgetattr(uart_fd, &options);
-    cfsetispeed(&options, SIM_UART_BAUD_RATE);
-    cfsetospeed(&options, SIM_UART_BAUD_RATE);
-    options.c_cflag |= (CLOCAL | CREAD);
-    options.c_cflag &= ~PARENB;
-    options.c_cflag &= ~CSTOPB;
-    options.c_cflag &= ~CSIZE;
-    options.c_cflag |= CS8;
-    tcsetattr(uart_fd, TCSANOW, &options);
+    int uart_fd = -1;
+    if (capture_options.replay_path) {
+        // Ответы SIM800 берутся из записи, UART не открывается
+        if (capture_open_replay(&player, capture_options.replay_path, capture_options.replay_fast) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        replaying = 1;
+        printf("Replaying UART from %s%s\n", capture_options.replay_path,
+               capture_options.replay_fast ? " (fast)" : "");
+    } else {
+        // Настройка UART
+        uart_fd = open(SIM_UART_PATH, O_RDWR | O_NOCTTY | O_NDELAY);
+        if (uart_fd == -1) {
+            perror("Ошибка открытия UART");
+            exit(EXIT_FAILURE);
+        }
+        printf("Opening UART on %s\n", SIM_UART_PATH); 
+
+        int baud = SIM_UART_BAUD_RATE;
+        if (configure_uart(uart_fd, baud) != 0) {
+            close(uart_fd);
+            exit(EXIT_FAILURE);
+        }
+        // Сначала пробуем сохраненную скорость: после перезапуска сервиса модем остался на ней
+        struct sim_handler_state state = {.baud = baud};
+        if (checkpoint_load(CHECKPOINT_PATH, &state, sizeof(state), NULL) == 0 && state.baud != baud &&
+            baud_to_speed(state.baud) != B0) {
+            configure_uart(uart_fd, state.baud);
+            if (send_config_command(uart_fd, "AT\r") == 0) {
+                printf("[CHECKPOINT] UART restored at %d\n", state.baud);
+                baud = state.baud;
+            } else {
+                configure_uart(uart_fd, baud);
+            }
+        }
+        if (SIM_UART_FAST_BAUD_RATE != 0 && SIM_UART_FAST_BAUD_RATE != baud) {
+            baud = negotiate_baud_rate(uart_fd, baud, SIM_UART_FAST_BAUD_RATE);
+        }
+        if (state.baud != baud) {
+            state.baud = baud;
+            if (checkpoint_save(CHECKPOINT_PATH, &state, sizeof(state)) != 0) {
+                perror("[CHECKPOINT] " CHECKPOINT_PATH);
+            }
+        }
+
+        // Включение инженерного режима: с автоматическими отчетами (URC) или без (опрос, адаптивный опрос)
+        if (SIM_CENG_MODE == SIM_CENG_MODE_URC) {
+            send_config_command(uart_fd, "AT+CENG=2,1\r");
+        } else {
+            send_config_command(uart_fd, "AT+CENG=1,1\r");
+        }
+        reset_snapshot();
+    }
 
     // Настройка UNIX-сокета для отправки данных
     int client_socket = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -103,24 +488,78 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    // Буфер для данных
-    char response_buffer[2048];
+    // Сокет обратной связи от cordcalculation: скорость и точность для адаптивного опроса.
+    // Датаграммы принимаются в любом режиме, чтобы статистика показывала качество решений
+    control_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un control_addr;
+    memset(&control_addr, 0, sizeof(control_addr));
+    control_addr.sun_family = AF_UNIX;
+    strncpy(control_addr.sun_path, CONTROL_SOCKET_PATH, sizeof(control_addr.sun_path) - 1);
+    unlink(CONTROL_SOCKET_PATH);
+    if (control_socket == -1 ||
+        bind(control_socket, (struct sockaddr *)&control_addr, sizeof(control_addr)) == -1) {
+        perror("Ошибка создания сокета обратной связи");
+        if (control_socket != -1) close(control_socket);
+        control_socket = -1;
+    }
+
     struct celltower towers[7] = {0};
+    long last_snapshot_ms = monotonic_ms();
+    long last_query_ms = 0;
+    int query_pending = 0;
+
+    rt_ready("sim_handler");
 
     while (1) {
-        // Отправка команды AT+CENG? для получения информации о вышках
-        send_command(uart_fd, "AT+CENG?\r");
+        long now = monotonic_ms();
+        drain_feedback(now);
+        report_stats(now);
+
+        // В режиме опроса запрос уходит сразу после предыдущего ответа,
+        // в адаптивном - через интервал от предыдущего запроса,
+        // в режиме URC - только если модем замолчал дольше таймаута
+        long query_interval = adaptive_interval_ms(now);
+        if (!replaying && !query_pending && (SIM_CENG_MODE == SIM_CENG_MODE_POLL ||
+                (SIM_CENG_MODE == SIM_CENG_MODE_ADAPTIVE && now - last_query_ms >= query_interval) ||
+                now - last_snapshot_ms >= SIM_URC_TIMEOUT_MS)) {
+            send_command(uart_fd, "AT+CENG?\r");
+            stats.queries++;
+            query_pending = 1;
+            last_query_ms = now;
+            last_snapshot_ms = now;
+        }
 
-        // Ожидание и чтение ответа от SIM800
-        int response_length = read_response(uart_fd, response_buffer, sizeof(response_buffer));
-        if (response_length <= 0) {
-            fprintf(stderr, "Ошибка: получен пустой ответ от SIM800\n");
+        long wait_ms = SIM_URC_TIMEOUT_MS - (now - last_snapshot_ms);
+        if (SIM_CENG_MODE == SIM_CENG_MODE_ADAPTIVE && !query_pending &&
+            last_query_ms + query_interval - now < wait_ms) {
+            wait_ms = last_query_ms + query_interval - now;
+        }
+        if (wait_ms < 1) wait_ms = 1;
+        int status = read_uart(uart_fd, wait_ms);
+        if (replay_finished) {
+            break;
+        }
+        if (status != 0) {
+            query_pending = 0;   // OK или ERROR закрывают ответ на AT+CENG?
+        } else if (monotonic_ms() - last_snapshot_ms >= SIM_URC_TIMEOUT_MS) {
+            if (query_pending) fprintf(stderr, "Ошибка: нет ответа от SIM800 на AT+CENG?\n");
+            query_pending = 0;
+        }
+        if (!snapshot_ready) {
             continue;
         }
 
+        printf("Получен снимок от SIM800 (всего байт: %zu):\n%s\n", snapshot_length, snapshot_buffer);
+        stats.snapshots++;
+        last_snapshot_ms = monotonic_ms();
+        if (stats.snapshots == 1) {
+            printf("[TTFF] sim_handler: first snapshot after %ldms\n", last_snapshot_ms - start_ms);
+        }
+
         // Парсинг ответа
-        uint8_t parsed_count = parse_ceng_response(response_buffer, towers);
+        uint8_t parsed_count = parse_ceng_response(snapshot_buffer, towers);
         printf("Количество распознанных вышек: %d\n", parsed_count);
+        reset_snapshot();
 
         // Вывод информации о каждой распознанной вышке для отладки
         for (int i = 0; i < parsed_count; i++) {
@@ -129,32 +568,21 @@ int main() {
         }
 
         // Отправка данных о вышках через UNIX-сокет на сервер
-        for (int i = 0; i < parsed_count; i++) {
-            struct {
-                uint16_t MCC;
-                uint16_t MNC;
-                uint32_t CID;
-                int receive_level;
-            } level_data;
-
-            level_data.MCC = towers[i].MCC;
-            level_data.MNC = towers[i].MNC;
-            level_data.CID = towers[i].CID;
-            level_data.receive_level = towers[i].RECEIVELEVEL;
-
-            printf("Отправка данных вышки через сокет: MCC=%d, MNC=%d, CID=%d, Уровень сигнала=%d\n",
-                   level_data.MCC, level_data.MNC, level_data.CID, level_data.receive_level);
-
-            if (send(client_socket, &level_data, sizeof(level_data), 0) == -1) {
-                perror("Ошибка при отправке данных через сокет");
-                close(client_socket);
-                close(uart_fd);
-                exit(EXIT_FAILURE);
-            }
+        if (send_snapshot(client_socket, towers, parsed_count) == -1) {
+            perror("Ошибка при отправке данных через сокет");
+            close(client_socket);
+            close(uart_fd);
+            exit(EXIT_FAILURE);
         }
     }
 
+    if (replaying) {
+        capture_report(&player, "sim_handler");
+    }
+    capture_close(&player);
+    capture_close(&recorder);
+    if (control_socket != -1) close(control_socket);
     close(client_socket);
-    close(uart_fd);
+    if (uart_fd != -1) close(uart_fd);
     return 0;
 }
@@ -0,0 +1,143 @@
+// ta_bench.c - сравнение точности трилатерации с кольцом TA обслуживающей вышки и без него
+//   ta_bench [SNAPSHOTS] [SIGMA_DB] - по умолчанию 5000 снимков, шум RSSI 6 дБ
+// Синтетические снимки: 4-7 вышек вокруг случайной точки в квадрате 2x2 км, RxLev по модели
+// 20*log10(d) + 40 с гауссовым шумом, обслуживающая вышка ближе 1.8 км. Оба прохода решают
+// одни и те же снимки (одно зерно), во втором у обслуживающей вышки известен TA.
+// Решатель тот же, что в cordcalculation: ransac_solve (RANSAC, trilaterate_3, refine_least_squares)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "geoprocessing.h"
+#include "ransac.h"
+
+#define BENCH_DEFAULT_SNAPSHOTS 5000
+#define BENCH_MAX_SNAPSHOTS 100000
+#define BENCH_DEFAULT_SIGMA_DB 6.0
+#define BENCH_SEED 42
+#define BENCH_LAT 55.75
+#define BENCH_LON 37.62
+
+struct bench_result {
+    int fixes;
+    double error_sum;
+    long iterations_sum, refined;
+    long hypotheses, pruned;
+    long solve_ns;
+};
+
+static long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static double gauss(void) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Решение снимка тем же ransac_solve, что в cordcalculation. Возвращает 0 и положение в fix или -1
+static int solve(const tower_info_t *towers, int count, struct bench_result *result, struct position_fix *fix) {
+    struct ransac_solution solution;
+    int status = ransac_solve(towers, count, fix, &solution);
+    result->hypotheses += solution.stats.hypotheses;
+    result->pruned += solution.stats.pruned;
+    if (status == 0 && solution.iterations > 0) {
+        result->iterations_sum += solution.iterations;
+        result->refined++;
+    }
+    return status;
+}
+
+static void run(int snapshots, double sigma_db, int use_ta, double *errors, struct bench_result *result) {
+    double m_per_deg_lat = deg_to_rad(1.0) * EARTH_RADIUS;
+    double m_per_deg_lon = m_per_deg_lat * cos(deg_to_rad(BENCH_LAT));
+    memset(result, 0, sizeof(*result));
+    srand(BENCH_SEED);
+
+    for (int s = 0; s < snapshots; s++) {
+        tower_info_t towers[RANSAC_MAX_TOWERS];
+        int count = 4 + rand() % 4;
+        double north = rand() % 2000 - 1000, east = rand() % 2000 - 1000;
+        for (int k = 0; k < count; k++) {
+            double bearing = 2.0 * M_PI * rand() / RAND_MAX;
+            double distance = k == 0 ? 300 + rand() % 1500 : 500 + rand() % 3000;
+            double level = 20.0 * log10(distance) + 40.0 + sigma_db * gauss();
+            towers[k] = (tower_info_t){
+                .msg_type = 1,
+                .receive_level = (int16_t)lround(level),
+                .TA = TA_UNKNOWN,
+                .LAT = BENCH_LAT + (north + distance * cos(bearing)) / m_per_deg_lat,
+                .LONG = BENCH_LON + (east + distance * sin(bearing)) / m_per_deg_lon,
+            };
+        }
+        if (use_ta) {
+            double serving_m = haversine(towers[0].LAT, towers[0].LONG,
+                                         BENCH_LAT + north / m_per_deg_lat, BENCH_LON + east / m_per_deg_lon);
+            towers[0].TA = (uint8_t)(serving_m / TA_STEP_M);
+        }
+
+        struct position_fix fix = {{0.0, 0.0}, NAN, NAN, NAN};
+        long start_ns = monotonic_ns();
+        int solved = solve(towers, count, result, &fix) == 0;
+        result->solve_ns += monotonic_ns() - start_ns;
+        if (solved) {
+            double error = haversine(fix.location.latitude, fix.location.longitude,
+                                     BENCH_LAT + north / m_per_deg_lat, BENCH_LON + east / m_per_deg_lon);
+            errors[result->fixes++] = error;
+            result->error_sum += error;
+        }
+    }
+    qsort(errors, result->fixes, sizeof(double), compare_double);
+}
+
+int main(int argc, char **argv) {
+    int snapshots = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_SNAPSHOTS;
+    double sigma_db = argc > 2 ? atof(argv[2]) : BENCH_DEFAULT_SIGMA_DB;
+    if (snapshots < 1 || snapshots > BENCH_MAX_SNAPSHOTS) {
+        fprintf(stderr, "Usage: %s [SNAPSHOTS (1..%d)] [SIGMA_DB]\n", argv[0], BENCH_MAX_SNAPSHOTS);
+        return 1;
+    }
+    double *errors = malloc(sizeof(double) * snapshots);
+    if (!errors) {
+        fprintf(stderr, "memory allocation error\n");
+        return 1;
+    }
+
+    // Отладочный вывод решателя (signal_to_distance) уходит в /dev/null, итог - в stderr
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull != -1) {
+        fflush(stdout);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+
+    fprintf(stderr, "%d snapshots, RSSI noise %.1f dB\n", snapshots, sigma_db);
+    for (int use_ta = 0; use_ta < 2; use_ta++) {
+        struct bench_result result;
+        run(snapshots, sigma_db, use_ta, errors, &result);
+        if (result.fixes == 0) {
+            fprintf(stderr, "%s: no fixes\n", use_ta ? "TA   " : "no TA");
+            continue;
+        }
+        fprintf(stderr, "%s: fixes=%d/%d mean=%.0fm median=%.0fm p90=%.0fm, GN iterations=%.2f, "
+                "hypotheses=%.1f (TA pruned %.1f), %.1fus/snapshot\n",
+                use_ta ? "TA   " : "no TA", result.fixes, snapshots, result.error_sum / result.fixes,
+                errors[result.fixes / 2], errors[result.fixes * 9 / 10],
+                result.refined ? (double)result.iterations_sum / result.refined : 0.0,
+                (double)result.hypotheses / snapshots, (double)result.pruned / snapshots,
+                result.solve_ns / 1000.0 / snapshots);
+    }
+    free(errors);
+    return 0;
+}